@@ -0,0 +1,41 @@
+#ifndef ALIGNED_ALLOCATOR_H
+#define ALIGNED_ALLOCATOR_H
+
+#include <vector>
+#include <cstdlib>
+#include <new>
+#include "AllocationCounter.h"
+
+// Allocator aligning every array to a cache line, so the SIMD kernels never split a load between two lines
+template <class T, std::size_t ALIGNMENT = 64>
+struct AlignedAllocator {
+	typedef T value_type;
+
+	template <class U> struct rebind { typedef AlignedAllocator<U, ALIGNMENT> other; };
+
+	AlignedAllocator() {}
+	template <class U> AlignedAllocator(const AlignedAllocator<U, ALIGNMENT>&) {}
+
+	T* allocate(std::size_t n) {
+		allocation_counter::add();
+		void* ptr = nullptr;
+		if (posix_memalign(&ptr, ALIGNMENT, n*sizeof(T)) != 0) {
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(ptr);
+	}
+
+	void deallocate(T* ptr, std::size_t) {
+		free(ptr);
+	}
+};
+
+template <class T, class U, std::size_t A>
+bool operator==(const AlignedAllocator<T,A>&, const AlignedAllocator<U,A>&) { return true; }
+template <class T, class U, std::size_t A>
+bool operator!=(const AlignedAllocator<T,A>&, const AlignedAllocator<U,A>&) { return false; }
+
+template <class T>
+using aligned_vector = std::vector<T, AlignedAllocator<T> >;
+
+#endif
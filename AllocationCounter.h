@@ -0,0 +1,37 @@
+// Number of heap allocations made by the program, to check that the steady-state loop does not allocate.
+// It only counts in builds with -DCOUNT_ALLOCATIONS (make locpf_debug): the aligned allocator counts its own
+// allocations and localization_pf.cpp replaces the global operator new to count the rest. Otherwise it is always 0.
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#ifdef COUNT_ALLOCATIONS
+#include <atomic>
+#endif
+
+namespace allocation_counter {
+
+#ifdef COUNT_ALLOCATIONS
+	inline std::atomic<unsigned long>& counter() {
+		static std::atomic<unsigned long> allocations(0);
+		return allocations;
+	}
+
+	inline void add() {
+		counter().fetch_add(1, std::memory_order_relaxed);
+	}
+
+	inline unsigned long allocations() {
+		return counter().load(std::memory_order_relaxed);
+	}
+#else
+	inline void add() {}
+
+	inline unsigned long allocations() {
+		return 0;
+	}
+#endif
+
+}
+
+#endif
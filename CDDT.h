@@ -0,0 +1,166 @@
+// Compressed directional distance transform (Walsh and Karaman, "CDDT: Fast Approximate 2D Ray Casting for
+// Accelerated Localization", 2018).
+// For every heading bin in [0, Pi) the wall cells are projected onto the lines (lanes) parallel to the heading.
+// Each lane keeps the sorted positions of its walls along the heading, so a ray is answered with a binary search
+// in the lane of its origin, forwards or backwards depending on the direction.
+// Only the wall cells next to a free cell are stored, which makes the structure much smaller than a full range table.
+
+#ifndef CDDT_H
+#define CDDT_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Map.h"
+#include "RayCaster.h"
+
+class CDDT : public RayCaster {
+
+	private:
+		struct AngleBin {
+			float cos_a;
+			float sin_a;
+			float lane_origin; // minimum projection on the normal of the heading
+			std::vector<unsigned> lane_offsets; // walls of lane l are projections[lane_offsets[l] .. lane_offsets[l+1])
+			std::vector<float> projections; // position of the centre of each wall along the heading
+		};
+
+		const Map &map;
+		const unsigned N_ANGLES; // bins in [0, Pi)
+		const float ANGLES_PER_RADIAN;
+
+		std::vector<AngleBin> bins;
+
+		// Occupied cells with at least one free 4-neighbour. Other occupied cells can never be hit first
+		std::vector<std::pair<float,float> > boundary_cells() {
+			std::vector<std::pair<float,float> > cells;
+			const int rows = map.height();
+			const int cols = map.width();
+			for (int y=0; y<rows; ++y) {
+				for (int x=0; x<cols; ++x) {
+					if (!map.isFree(x, y) && (map.isFree(x+1, y) || map.isFree(x-1, y) || map.isFree(x, y+1) || map.isFree(x, y-1))) {
+						cells.push_back(std::make_pair(x + 0.5f, y + 0.5f));
+					}
+				}
+			}
+			return cells;
+		}
+
+		void build_bin(AngleBin &bin, float angle, const std::vector<std::pair<float,float> > &cells) {
+			bin.cos_a = std::cos(angle);
+			bin.sin_a = std::sin(angle);
+
+			// A cell covers this width around its centre on the normal of the heading
+			const float half_width = 0.5f*(std::abs(bin.cos_a) + std::abs(bin.sin_a));
+
+			bin.lane_origin = INFINITY;
+			float lane_end = -INFINITY;
+			for (auto &c : cells) {
+				const float s = -c.first*bin.sin_a + c.second*bin.cos_a;
+				bin.lane_origin = std::min(bin.lane_origin, s - half_width);
+				lane_end = std::max(lane_end, s + half_width);
+			}
+
+			if (cells.empty()) {
+				bin.lane_origin = 0.0f;
+				bin.lane_offsets.assign(1, 0);
+				return;
+			}
+
+			const unsigned nlanes = (unsigned)(lane_end - bin.lane_origin) + 1;
+
+			// Counting sort of the cells into their lanes, then sort each lane along the heading
+			bin.lane_offsets.assign(nlanes + 1, 0);
+			for (int pass=0; pass<2; ++pass) {
+				std::vector<unsigned> fill;
+				if (pass == 1) {
+					for (unsigned l=0; l<nlanes; ++l) {
+						bin.lane_offsets[l+1] += bin.lane_offsets[l];
+					}
+					bin.projections.resize(bin.lane_offsets[nlanes]);
+					fill.assign(bin.lane_offsets.begin(), bin.lane_offsets.end() - 1);
+				}
+
+				for (auto &c : cells) {
+					const float s = -c.first*bin.sin_a + c.second*bin.cos_a - bin.lane_origin;
+					const float t = c.first*bin.cos_a + c.second*bin.sin_a;
+					const unsigned first = (unsigned)std::max(0.0f, s - half_width);
+					const unsigned last = std::min(nlanes - 1, (unsigned)(s + half_width));
+					for (unsigned l=first; l<=last; ++l) {
+						if (pass == 0) {
+							++bin.lane_offsets[l+1];
+						} else {
+							bin.projections[fill[l]++] = t;
+						}
+					}
+				}
+			}
+
+			for (unsigned l=0; l<nlanes; ++l) {
+				std::sort(bin.projections.begin() + bin.lane_offsets[l], bin.projections.begin() + bin.lane_offsets[l+1]);
+			}
+		}
+
+	public:
+		CDDT(const Map &user_map, float angular_resolution):
+			 map(user_map),
+			 N_ANGLES(std::max(1, (int)std::round(M_PI/angular_resolution))),
+			 ANGLES_PER_RADIAN(N_ANGLES/M_PI),
+			 bins(N_ANGLES) {
+
+			const std::vector<std::pair<float,float> > cells = boundary_cells();
+
+			#pragma omp parallel for schedule(dynamic)
+			for (int a=0; a<(int)N_ANGLES; ++a) {
+				build_bin(bins[a], a/ANGLES_PER_RADIAN, cells);
+			}
+		}
+
+		float range(float x, float y, float alpha, unsigned horizon_length) const {
+			int a = (int)std::round(alpha*ANGLES_PER_RADIAN) % (int)(2*N_ANGLES);
+			if (a < 0) {
+				a += 2*N_ANGLES;
+			}
+			// Headings in [Pi, 2*Pi) search the lane of the opposite heading backwards
+			const bool backwards = a >= (int)N_ANGLES;
+			const AngleBin &bin = bins[backwards ? a - N_ANGLES : a];
+
+			const float s = -x*bin.sin_a + y*bin.cos_a - bin.lane_origin;
+			if (s < 0.0f || s >= bin.lane_offsets.size() - 1) {
+				return -1;
+			}
+
+			const unsigned lane = (unsigned)s;
+			const float *begin = bin.projections.data() + bin.lane_offsets[lane];
+			const float *end = bin.projections.data() + bin.lane_offsets[lane+1];
+			const float t = x*bin.cos_a + y*bin.sin_a;
+
+			float distance;
+			if (!backwards) {
+				const float *wall = std::upper_bound(begin, end, t);
+				if (wall == end) {
+					return -1;
+				}
+				distance = *wall - 0.5f - t;
+			} else {
+				const float *wall = std::lower_bound(begin, end, t);
+				if (wall == begin) {
+					return -1;
+				}
+				distance = t - *(wall-1) - 0.5f;
+			}
+
+			distance = std::max(0.0f, distance);
+			return distance < horizon_length ? distance : -1;
+		}
+
+		size_t memoryUsage() const {
+			size_t bytes = 0;
+			for (auto &bin : bins) {
+				bytes += bin.lane_offsets.size()*sizeof(unsigned) + bin.projections.size()*sizeof(float);
+			}
+			return bytes;
+		}
+};
+
+#endif
@@ -0,0 +1,154 @@
+// Counter-based random number generator (Philox4x32-10, from Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// Every random value is a pure function of (seed, stream, index), so any range of a stream can be generated
+// independently by any thread, and the result does not depend on how the work is split.
+
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <stdint.h>
+#include <cmath>
+#include "Simd.h"
+
+class CounterRNG {
+
+	private:
+		uint32_t key[2];
+
+		static const uint32_t PHILOX_M0 = 0xD2511F53;
+		static const uint32_t PHILOX_M1 = 0xCD9E8D57;
+		static const uint32_t PHILOX_W0 = 0x9E3779B9;
+		static const uint32_t PHILOX_W1 = 0xBB67AE85;
+		static const unsigned PHILOX_ROUNDS = 10;
+
+		// Normals are produced in groups of 32: one AVX2 iteration runs 8 Philox blocks of 4 words each.
+		// Element j (0..3) of block k (0..7) is stored at position 8*j+k of the group.
+		static const unsigned GROUP_SIZE = 32;
+
+		static void philox(uint32_t ctr[4], uint32_t k0, uint32_t k1) {
+			for (unsigned r=0; r<PHILOX_ROUNDS; ++r) {
+				const uint64_t p0 = (uint64_t)PHILOX_M0*ctr[0];
+				const uint64_t p1 = (uint64_t)PHILOX_M1*ctr[2];
+				const uint32_t c1 = ctr[1];
+				const uint32_t c3 = ctr[3];
+				ctr[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+				ctr[1] = (uint32_t)p1;
+				ctr[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+				ctr[3] = (uint32_t)p0;
+				k0 += PHILOX_W0;
+				k1 += PHILOX_W1;
+			}
+		}
+
+		// Maps 32 random bits to a float in (0,1), never 0 so that its logarithm is finite
+		static float to_uniform(uint32_t bits) {
+			return ((bits >> 8) + 0.5f)*(1.0f/16777216.0f);
+		}
+
+		// Box-Muller transform of the 4 words of block 'block' of 'stream'
+		void normal_block(uint64_t stream, uint64_t block, float out[4]) const {
+			uint32_t ctr[4] = {(uint32_t)block, (uint32_t)(block >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+			philox(ctr, key[0], key[1]);
+			for (unsigned j=0; j<4; j+=2) {
+				const float r = std::sqrt(-2.0f*std::log(to_uniform(ctr[j])));
+				const float theta = 2.0f*M_PI*to_uniform(ctr[j+1]);
+				out[j] = r*std::cos(theta);
+				out[j+1] = r*std::sin(theta);
+			}
+		}
+
+		// Standard normal at position i of 'stream'
+		float normal_at(uint64_t stream, uint64_t i) const {
+			const uint64_t group = i/GROUP_SIZE;
+			const unsigned offset = i%GROUP_SIZE;
+			float out[4];
+			normal_block(stream, group*8 + offset%8, out);
+			return out[offset/8];
+		}
+
+		SIMD_AVX2 static inline void mul_hi_lo(__m256i a, __m256i m, __m256i *hi, __m256i *lo) {
+			const __m256i even = _mm256_mul_epu32(a, m);
+			const __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), m);
+			*lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+			*hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+		}
+
+		SIMD_AVX2 static inline __m256 to_uniform_ps(__m256i bits) {
+			const __m256 u = _mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 8));
+			return _mm256_mul_ps(_mm256_add_ps(u, _mm256_set1_ps(0.5f)), _mm256_set1_ps(1.0f/16777216.0f));
+		}
+
+		// One full group of 32 normals, 8 Philox blocks in parallel
+		SIMD_AVX2 void normal_group_avx2(uint64_t stream, uint64_t group, float *out, float mean, float std) const {
+			const uint64_t block = group*8;
+			__m256i c0 = _mm256_add_epi32(_mm256_set1_epi32((uint32_t)block), _mm256_setr_epi32(0,1,2,3,4,5,6,7));
+			__m256i c1 = _mm256_set1_epi32((uint32_t)(block >> 32)); // blocks are multiple of 8, so the low word never wraps
+			__m256i c2 = _mm256_set1_epi32((uint32_t)stream);
+			__m256i c3 = _mm256_set1_epi32((uint32_t)(stream >> 32));
+			__m256i k0 = _mm256_set1_epi32(key[0]);
+			__m256i k1 = _mm256_set1_epi32(key[1]);
+			const __m256i m0 = _mm256_set1_epi32(PHILOX_M0);
+			const __m256i m1 = _mm256_set1_epi32(PHILOX_M1);
+			for (unsigned r=0; r<PHILOX_ROUNDS; ++r) {
+				__m256i hi0, lo0, hi1, lo1;
+				mul_hi_lo(c0, m0, &hi0, &lo0);
+				mul_hi_lo(c2, m1, &hi1, &lo1);
+				const __m256i n0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), k0);
+				const __m256i n2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), k1);
+				c0 = n0;
+				c1 = lo1;
+				c2 = n2;
+				c3 = lo0;
+				k0 = _mm256_add_epi32(k0, _mm256_set1_epi32(PHILOX_W0));
+				k1 = _mm256_add_epi32(k1, _mm256_set1_epi32(PHILOX_W1));
+			}
+
+			const __m256 v_mean = _mm256_set1_ps(mean);
+			const __m256 v_std = _mm256_set1_ps(std);
+			const __m256i words[4] = {c0, c1, c2, c3};
+			for (unsigned j=0; j<4; j+=2) {
+				const __m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), simd::log_ps(to_uniform_ps(words[j]))));
+				const __m256 theta = _mm256_mul_ps(_mm256_set1_ps(2.0f*M_PI), to_uniform_ps(words[j+1]));
+				__m256 s, c;
+				simd::sincos_ps(theta, &s, &c);
+				_mm256_storeu_ps(out + 8*j, _mm256_fmadd_ps(_mm256_mul_ps(r, c), v_std, v_mean));
+				_mm256_storeu_ps(out + 8*(j+1), _mm256_fmadd_ps(_mm256_mul_ps(r, s), v_std, v_mean));
+			}
+		}
+
+	public:
+
+		CounterRNG(uint64_t seed = 0) {
+			setSeed(seed);
+		}
+
+		void setSeed(uint64_t seed) {
+			key[0] = (uint32_t)seed;
+			key[1] = (uint32_t)(seed >> 32);
+		}
+
+		// Fills out[begin..end) with the elements begin..end of a stream of normal samples.
+		// Calls on disjoint ranges of the same stream can run concurrently.
+		void generateNormals(float *out, uint64_t stream, unsigned begin, unsigned end, float mean, float std) const {
+			unsigned i = begin;
+			if (cpuHasAVX2()) {
+				for (; i<end && i%GROUP_SIZE != 0; ++i) {
+					out[i] = mean + std*normal_at(stream, i);
+				}
+				for (; i+GROUP_SIZE<=end; i+=GROUP_SIZE) {
+					normal_group_avx2(stream, i/GROUP_SIZE, out+i, mean, std);
+				}
+			}
+			for (; i<end; ++i) {
+				out[i] = mean + std*normal_at(stream, i);
+			}
+		}
+
+		// Uniform float in [0,1) at position i of 'stream'
+		float uniform(uint64_t stream, uint64_t i) const {
+			uint32_t ctr[4] = {(uint32_t)i, (uint32_t)(i >> 32), (uint32_t)stream, (uint32_t)(stream >> 32)};
+			philox(ctr, key[0], key[1]);
+			return (ctr[0] >> 8)*(1.0f/16777216.0f);
+		}
+};
+
+#endif
@@ -0,0 +1,208 @@
+// Exact grid traversal (Amanatides and Woo, "A Fast Voxel Traversal Algorithm for Ray Tracing", 1987).
+// Visits every cell crossed by the ray exactly once, in order, with one comparison and one addition per cell,
+// and returns the distance at which the ray enters the first wall cell. Walls one cell thick are never skipped.
+// castBatch advances 8 rays in lockstep with AVX2, reading the cells of a row major occupancy grid with gathers.
+
+#ifndef DDA_TRAVERSAL_H
+#define DDA_TRAVERSAL_H
+
+#include <cmath>
+#include <stdint.h>
+#include "Map.h"
+#include "RayCaster.h"
+#include "Simd.h"
+
+class DDATraversal : public RayCaster {
+
+	private:
+		const Map &map;
+		
+		// State of 8 rays traversed in lockstep with AVX2 (see range() for the meaning of each variable)
+		struct RayLanes {
+			__m256 t, next_x, next_y, delta_x, delta_y;
+			__m256i step_x, index, index_step_y;
+			__m256 active; // lanes whose ray is still running
+			__m256 result;
+		};
+		
+		SIMD_AVX2 void start_lanes(RayLanes &lanes, const float *x, const float *y, const float *alpha, float angle_offset) const {
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+			
+			const __m256 px = _mm256_loadu_ps(x);
+			const __m256 py = _mm256_loadu_ps(y);
+			__m256 dy, dx;
+			simd::sincos_ps(_mm256_add_ps(_mm256_loadu_ps(alpha), _mm256_set1_ps(angle_offset)), &dy, &dx);
+			
+			const __m256 floor_x = _mm256_floor_ps(px);
+			const __m256 floor_y = _mm256_floor_ps(py);
+			const __m256i cell_x = _mm256_cvttps_epi32(floor_x);
+			const __m256i cell_y = _mm256_cvttps_epi32(floor_y);
+			
+			const __m256 positive_x = _mm256_cmp_ps(dx, zero, _CMP_GT_OQ);
+			const __m256 positive_y = _mm256_cmp_ps(dy, zero, _CMP_GT_OQ);
+			lanes.step_x = _mm256_blendv_epi8(_mm256_set1_epi32(-1), _mm256_set1_epi32(1), _mm256_castps_si256(positive_x));
+			const __m256i step_y = _mm256_blendv_epi8(_mm256_set1_epi32(-1), _mm256_set1_epi32(1), _mm256_castps_si256(positive_y));
+			
+			lanes.delta_x = _mm256_and_ps(_mm256_div_ps(one, dx), abs_mask);
+			lanes.delta_y = _mm256_and_ps(_mm256_div_ps(one, dy), abs_mask);
+			const __m256 border_x = _mm256_blendv_ps(_mm256_sub_ps(px, floor_x), _mm256_sub_ps(_mm256_add_ps(floor_x, one), px), positive_x);
+			const __m256 border_y = _mm256_blendv_ps(_mm256_sub_ps(py, floor_y), _mm256_sub_ps(_mm256_add_ps(floor_y, one), py), positive_y);
+			lanes.next_x = _mm256_blendv_ps(_mm256_mul_ps(border_x, lanes.delta_x), _mm256_set1_ps(INFINITY), _mm256_cmp_ps(dx, zero, _CMP_EQ_OQ));
+			lanes.next_y = _mm256_blendv_ps(_mm256_mul_ps(border_y, lanes.delta_y), _mm256_set1_ps(INFINITY), _mm256_cmp_ps(dy, zero, _CMP_EQ_OQ));
+			
+			const __m256i stride = _mm256_set1_epi32(map.grid.stride());
+			lanes.index_step_y = _mm256_mullo_epi32(step_y, stride);
+			lanes.index = _mm256_add_epi32(_mm256_mullo_epi32(cell_y, stride), cell_x);
+			
+			// Rays starting outside the grid stop at once, as in range()
+			const __m256i inside = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(cell_x, _mm256_set1_epi32(-1)),
+																	 _mm256_cmpgt_epi32(_mm256_set1_epi32(map.width()), cell_x)),
+													_mm256_and_si256(_mm256_cmpgt_epi32(cell_y, _mm256_set1_epi32(-1)),
+																	 _mm256_cmpgt_epi32(_mm256_set1_epi32(map.height()), cell_y)));
+			lanes.t = zero;
+			lanes.active = _mm256_castsi256_ps(inside);
+			lanes.result = _mm256_blendv_ps(zero, _mm256_set1_ps(-1.0f), lanes.active);
+		}
+		
+		// One iteration of the loop of range() on every running lane. Returns false once all the lanes have stopped
+		SIMD_AVX2 bool step_lanes(RayLanes &lanes, __m256 horizon) const {
+			lanes.active = _mm256_and_ps(lanes.active, _mm256_cmp_ps(lanes.t, horizon, _CMP_LT_OQ));
+			if (_mm256_movemask_ps(lanes.active) == 0) {
+				return false;
+			}
+			
+			// Only the running lanes are gathered. The guard border of the grid stops them before they leave it.
+			// Each gather loads 4 bytes, of which the lowest one is the cell
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i cell = _mm256_mask_i32gather_epi32(zero, reinterpret_cast<const int*>(map.grid.cells()), lanes.index,
+															 _mm256_castps_si256(lanes.active), 1);
+			const __m256i free = _mm256_cmpeq_epi32(_mm256_and_si256(cell, _mm256_set1_epi32(0xFF)), zero);
+			const __m256 hit = _mm256_andnot_ps(_mm256_castsi256_ps(free), lanes.active);
+			lanes.result = _mm256_blendv_ps(lanes.result, lanes.t, hit);
+			lanes.active = _mm256_andnot_ps(hit, lanes.active);
+			
+			// Step to the closest border
+			const __m256 cross_x = _mm256_cmp_ps(lanes.next_x, lanes.next_y, _CMP_LT_OQ);
+			const __m256i cross_x_i = _mm256_castps_si256(cross_x);
+			lanes.t = _mm256_blendv_ps(lanes.next_y, lanes.next_x, cross_x);
+			lanes.next_x = _mm256_add_ps(lanes.next_x, _mm256_and_ps(lanes.delta_x, cross_x));
+			lanes.next_y = _mm256_add_ps(lanes.next_y, _mm256_andnot_ps(cross_x, lanes.delta_y));
+			lanes.index = _mm256_add_epi32(lanes.index, _mm256_blendv_epi8(lanes.index_step_y, lanes.step_x, cross_x_i));
+			return true;
+		}
+		
+		// Casts 8*GROUPS rays. The groups are interleaved, so the latency of the gathers and of the loop
+		// carried comparisons of one group overlaps with the work of the others
+		template <int GROUPS>
+		SIMD_AVX2 void range_avx2(const float *x, const float *y, const float *alpha, float angle_offset,
+								  unsigned horizon_length, float *ranges) const {
+			RayLanes lanes[GROUPS];
+			for (int g=0; g<GROUPS; ++g) {
+				start_lanes(lanes[g], x + 8*g, y + 8*g, alpha + 8*g, angle_offset);
+			}
+			
+			const __m256 horizon = _mm256_set1_ps((float)horizon_length);
+			bool running = true;
+			while (running) {
+				running = false;
+				for (int g=0; g<GROUPS; ++g) {
+					running |= step_lanes(lanes[g], horizon);
+				}
+			}
+			
+			for (int g=0; g<GROUPS; ++g) {
+				_mm256_storeu_ps(ranges + 8*g, lanes[g].result);
+			}
+		}
+		
+		// Loop of range(), without bounds checks. The index of the cell is updated incrementally: with the tiled layout,
+		// it is only computed from the coordinates when the ray enters a new tile
+		template <GridLayout LAYOUT>
+		float traverse(int cell_x, int cell_y, int step_x, int step_y,
+					   float next_x, float next_y, float delta_x, float delta_y, unsigned horizon_length) const {
+			const OccupancyGrid &grid = map.grid;
+			const uint8_t *cells = grid.data();
+			const long index_step_y = LAYOUT == TILED ? (long)step_y << OccupancyGrid::TILE_SHIFT : (long)step_y*grid.stride();
+			long index = LAYOUT == TILED ? grid.tiledOffset(cell_x, cell_y) : grid.rowMajorOffset(cell_x, cell_y);
+			// Position in the tile of the first cell of the next tile in each direction
+			const int tile_entry_x = step_x > 0 ? 0 : OccupancyGrid::TILE_MASK;
+			const int tile_entry_y = step_y > 0 ? 0 : OccupancyGrid::TILE_MASK;
+			
+			float t = 0.0f;
+			while (t < horizon_length) {
+				if (cells[index] != 0) {
+					return t;
+				}
+				
+				if (next_x < next_y) {
+					t = next_x;
+					next_x += delta_x;
+					cell_x += step_x;
+					index += step_x;
+					if (LAYOUT == TILED && ((cell_x + OccupancyGrid::BORDER) & OccupancyGrid::TILE_MASK) == tile_entry_x) {
+						index = grid.tiledOffset(cell_x, cell_y);
+					}
+				} else {
+					t = next_y;
+					next_y += delta_y;
+					cell_y += step_y;
+					index += index_step_y;
+					if (LAYOUT == TILED && ((cell_y + OccupancyGrid::BORDER) & OccupancyGrid::TILE_MASK) == tile_entry_y) {
+						index = grid.tiledOffset(cell_x, cell_y);
+					}
+				}
+			}
+			
+			return -1;
+		}
+		
+	public:
+		DDATraversal(const Map &user_map): map(user_map) {}
+		
+		float range(float x, float y, float alpha, unsigned horizon_length) const {
+			const float dx = std::cos(alpha);
+			const float dy = std::sin(alpha);
+			
+			const int cell_x = (int)std::floor(x);
+			const int cell_y = (int)std::floor(y);
+			const int step_x = dx > 0.0f ? 1 : -1;
+			const int step_y = dy > 0.0f ? 1 : -1;
+			
+			// Distance along the ray between two vertical (resp. horizontal) cell borders,
+			// and distance to the next one
+			const float delta_x = dx != 0.0f ? std::abs(1.0f/dx) : INFINITY;
+			const float delta_y = dy != 0.0f ? std::abs(1.0f/dy) : INFINITY;
+			float next_x = dx > 0.0f ? (cell_x + 1 - x)*delta_x : (x - cell_x)*delta_x;
+			float next_y = dy > 0.0f ? (cell_y + 1 - y)*delta_y : (y - cell_y)*delta_y;
+			if (dx == 0.0f) next_x = INFINITY;
+			if (dy == 0.0f) next_y = INFINITY;
+			
+			// A ray starting outside the grid stops at once. Inside it, the guard border stops the ray before it leaves the grid
+			if (!map.grid.inside(cell_x, cell_y)) {
+				return 0.0f;
+			}
+			if (map.grid.layout() == TILED) {
+				return traverse<TILED>(cell_x, cell_y, step_x, step_y, next_x, next_y, delta_x, delta_y, horizon_length);
+			}
+			return traverse<ROW_MAJOR>(cell_x, cell_y, step_x, step_y, next_x, next_y, delta_x, delta_y, horizon_length);
+		}
+		
+		void castBatch(const float *x, const float *y, const float *alpha, float angle_offset,
+					   unsigned n, unsigned horizon_length, float *ranges) const {
+			unsigned i = 0;
+			// The gathers index the row major layout
+			if (cpuHasAVX2() && map.grid.layout() == ROW_MAJOR) {
+				for (; i+16<=n; i+=16) {
+					range_avx2<2>(x+i, y+i, alpha+i, angle_offset, horizon_length, ranges+i);
+				}
+				for (; i+8<=n; i+=8) {
+					range_avx2<1>(x+i, y+i, alpha+i, angle_offset, horizon_length, ranges+i);
+				}
+			}
+			RayCaster::castBatch(x+i, y+i, alpha+i, angle_offset, n-i, horizon_length, ranges+i);
+		}
+};
+
+#endif
@@ -0,0 +1,79 @@
+// Keeps the duration of a filter cycle (move, update, resample and snapshot of the particles, without the rendering,
+// which runs on its own thread) under a latency budget by adapting the number of particles. The cycle time is
+// modelled as proportional to the number of particles, with the cost per particle estimated from the measured cycles,
+// so it adapts to whatever machine the filter runs on.
+
+#ifndef DEADLINE_CONTROLLER_H
+#define DEADLINE_CONTROLLER_H
+
+#include <chrono>
+#include <algorithm>
+
+class DeadlineController {
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		const double BUDGET; // seconds
+		const double TARGET_FRACTION = 0.8; // fraction of the budget aimed at, to absorb jitter
+		const double SMOOTHING = 0.3; // weight of the last cycle in the cost estimate
+		const double MAX_GROWTH = 1.25; // the particle count changes at most this much per cycle...
+		const double MAX_SHRINK = 0.5; // ... in each direction
+
+		unsigned min_particles;
+		unsigned max_particles;
+
+		Clock::time_point cycle_start;
+		double cost_per_particle = 0.0;
+		double last_cycle_time = 0.0;
+
+		unsigned long cycles = 0;
+		unsigned long deadline_misses = 0;
+
+	public:
+
+		DeadlineController(double budget_seconds, unsigned min_part, unsigned max_part):
+						   BUDGET(budget_seconds), min_particles(min_part), max_particles(std::max(min_part, max_part)) {}
+
+		void startCycle() {
+			cycle_start = Clock::now();
+		}
+
+		// Ends the cycle started by startCycle(), in which 'particles' particles were processed,
+		// and returns the number of particles that should fit in the budget for the next one
+		unsigned endCycle(unsigned particles) {
+			last_cycle_time = std::chrono::duration<double>(Clock::now() - cycle_start).count();
+			++cycles;
+			if (last_cycle_time > BUDGET) {
+				++deadline_misses;
+			}
+
+			if (particles == 0) {
+				return min_particles;
+			}
+
+			const double cost = last_cycle_time/particles;
+			cost_per_particle = cost_per_particle > 0.0 ? SMOOTHING*cost + (1.0-SMOOTHING)*cost_per_particle : cost;
+
+			double next = TARGET_FRACTION*BUDGET/cost_per_particle;
+			next = std::min(next, particles*MAX_GROWTH);
+			next = std::max(next, particles*MAX_SHRINK);
+			next = std::min<double>(std::max<double>(next, min_particles), max_particles);
+
+			return (unsigned)next;
+		}
+
+		double getLastCycleTime() {
+			return last_cycle_time;
+		}
+
+		unsigned long getCycles() {
+			return cycles;
+		}
+
+		unsigned long getDeadlineMisses() {
+			return deadline_misses;
+		}
+};
+
+#endif
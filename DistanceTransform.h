@@ -0,0 +1,97 @@
+// Euclidean distance transform in linear time (Felzenszwalb and Huttenlocher, "Distance Transforms of Sampled
+// Functions", 2012): a 1D squared distance transform along every column, then along every row of the result.
+
+#ifndef DISTANCE_TRANSFORM_H
+#define DISTANCE_TRANSFORM_H
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "Map.h"
+
+namespace distance_transform {
+
+	// Squared distance of the cells far from every wall. Finite, so that the difference of two of them is still a number
+	const float FAR = 1e20f;
+
+	// In place 1D squared distance transform of the n samples f[0], f[stride], ... f[(n-1)*stride].
+	// d, v and z are scratch buffers of n, n and n+1 elements
+	inline void squared_1d(float *f, int n, int stride, std::vector<float> &d, std::vector<int> &v, std::vector<float> &z) {
+		// Lower envelope of the parabolas rooted at each sample: v holds their roots, z the boundaries between them
+		int k = 0;
+		v[0] = 0;
+		z[0] = -INFINITY;
+		z[1] = INFINITY;
+		for (int q=1; q<n; ++q) {
+			const float fq = f[q*stride] + (float)q*q;
+			float s;
+			while (true) {
+				const int p = v[k];
+				s = (fq - (f[p*stride] + (float)p*p))/(2.0f*(q - p));
+				if (s > z[k]) {
+					break;
+				}
+				--k;
+			}
+			++k;
+			v[k] = q;
+			z[k] = s;
+			z[k+1] = INFINITY;
+		}
+
+		k = 0;
+		for (int q=0; q<n; ++q) {
+			while (z[k+1] < q) {
+				++k;
+			}
+			const float diff = q - v[k];
+			d[q] = diff*diff + f[v[k]*stride];
+		}
+		for (int q=0; q<n; ++q) {
+			f[q*stride] = d[q];
+		}
+	}
+
+}
+
+// Distance (in cells) from every cell of a rows x cols grid to the centre of the closest cell for which wall(x, y) is true
+template <class IsWall>
+CellMatrix distanceTransform(int rows, int cols, IsWall wall) {
+	CellMatrix dist(rows, cols);
+	for (int y=0; y<rows; ++y) {
+		for (int x=0; x<cols; ++x) {
+			dist(y, x) = wall(x, y) ? 0.0f : distance_transform::FAR;
+		}
+	}
+
+	float *data = dist.data(); // row major
+	const int n = std::max(rows, cols);
+
+	#pragma omp parallel
+	{
+		std::vector<float> d(n), z(n+1);
+		std::vector<int> v(n);
+
+		// Columns
+		#pragma omp for
+		for (int x=0; x<cols; ++x) {
+			distance_transform::squared_1d(data + x, rows, cols, d, v, z);
+		}
+
+		// Rows (contiguous)
+		#pragma omp for
+		for (int y=0; y<rows; ++y) {
+			distance_transform::squared_1d(data + (size_t)y*cols, cols, 1, d, v, z);
+		}
+	}
+
+	return dist.array().sqrt().matrix();
+}
+
+// Distance from every cell of the map to the closest cell that is not free (see Map::isFree)
+inline CellMatrix distanceField(const Map &map) {
+	return distanceTransform(map.height(), map.width(), [&map](int x, int y) { return !map.isFree(x, y); });
+}
+
+#endif
@@ -0,0 +1,243 @@
+// Parameters, command line options and update cycle shared by the programs running the particle filter
+// (localization_pf and localization_server), so both model the robot and handle its readings the same way.
+
+#ifndef FILTER_SETUP_H
+#define FILTER_SETUP_H
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <cmath>
+#include "ParticleFilter.h"
+#include "Frame.h"
+
+#define MAP_MARGIN 3
+#define MAP_CELLS_PER_METRE 100
+
+
+// Particle filter parameters
+const float SPEED_F = 0.22f; // meters/second
+const float SPEED_B = 0.2f; // meters/second
+const float SPEED_R = 2.0f*M_PI; // rads/second
+const float COMMAND_DURATION = 1.0f/20.0f; // aproximation of command duration
+const float S_X_F = 0.03f;
+const float S_Y_F = 0.01f;
+const float S_X_B = 0.02f;
+const float S_Y_B = 0.01f;
+const float S_ALPHA = 0.5f;
+const float S_LIDAR = 0.2f;
+const float LIDAR_MIN = 0.2f;
+const float LIDAR_MAX = 2.0f;
+
+// Adaptive number of particles
+const int DEFAULT_MIN_PARTICLES = 1000;
+
+const unsigned MAX_BEAMS = 360; // beams of a reading used by the filter, longer scans are subsampled
+
+// Reading received from the controller (see Frame.h)
+struct Reading {
+	Action command;
+	unsigned nbeams;
+	float angle_step; // radians between consecutive beams, clockwise
+	float ranges[MAX_BEAMS]; // metres, the first one along the heading
+};
+
+// Consecutive readings with the same command, applied as a single motion
+struct CommandRun {
+	Action command;
+	unsigned steps;
+};
+
+// Filter options given on the command line (see parseFilterOption)
+struct FilterOptions {
+	ResamplingMethod resampling_method = SYSTEMATIC;
+	int min_particles = DEFAULT_MIN_PARTICLES;
+	bool kld_sampling = false;
+	RayCastMethod ray_cast_method = DDA;
+	float angular_resolution = 1.0f; // degrees
+	SensorModel sensor_model = BEAM_MODEL;
+	GridLayout map_layout = ROW_MAJOR;
+	unsigned reorder_period = 0;
+	bool compress_duplicates = false;
+	bool stationary_updates = false;
+};
+
+// State kept by runCycle() between the cycles of one filter
+struct CycleState {
+	float previous_lidar_sensor_data = 0.0f;
+	std::vector<Beam> beams; // reused by every scan
+
+	CycleState() {
+		beams.reserve(MAX_BEAMS);
+	}
+};
+
+inline void printFilterOptions() {
+	std::cout << "  --resampling systematic|stratified|residual" <<std::endl;
+	std::cout << "  --min <n>        minimum number of particles of the adaptive modes (default " << DEFAULT_MIN_PARTICLES << ")" <<std::endl;
+	std::cout << "  --kld            adapt the number of particles to the belief (KLD-sampling)" <<std::endl;
+	std::cout << "  --raycast dda|marching|table|cddt|sphere|pyramid [resolution_degrees] (default dda)" <<std::endl;
+	std::cout << "  --sensor beam|field  score the reading by ray casting or with the likelihood field (default beam)" <<std::endl;
+	std::cout << "  --layout row|tiled   storage of the map cells: rows or 8x8 tiles in Z-order (default row)" <<std::endl;
+	std::cout << "  --reorder <k>    sort the particles along a Hilbert curve every k resamples (default 0, never)" <<std::endl;
+	std::cout << "  --compress       store the copies made by the resampling as one particle with a count. Every motion" <<std::endl;
+	std::cout << "                   expands them: it only saves work on --stationary updates right after a resampling" <<std::endl;
+	std::cout << "  --stationary     also score the readings taken while the robot stands still, without resampling" <<std::endl;
+}
+
+// Reads the filter option at arg[i], and its values, into options. Returns false if arg[i] is not a filter option
+inline bool parseFilterOption(int narg, char *arg[], int &i, FilterOptions &options) {
+	std::string option(arg[i]);
+	if (option == "--resampling" && i+1 < narg) {
+		std::string method(arg[++i]);
+		if (method == "stratified") {
+			options.resampling_method = STRATIFIED;
+		} else if (method == "residual") {
+			options.resampling_method = RESIDUAL;
+		}
+	} else if (option == "--min" && i+1 < narg) {
+		options.min_particles = std::stoi(arg[++i]);
+	} else if (option == "--kld") {
+		options.kld_sampling = true;
+	} else if (option == "--raycast" && i+1 < narg) {
+		std::string method(arg[++i]);
+		if (method == "marching") {
+			options.ray_cast_method = RAY_MARCHING;
+		} else if (method == "table") {
+			options.ray_cast_method = LOOKUP_TABLE;
+		} else if (method == "cddt") {
+			options.ray_cast_method = COMPRESSED_DDT;
+		} else if (method == "sphere") {
+			options.ray_cast_method = SPHERE_TRACING;
+		} else if (method == "pyramid") {
+			options.ray_cast_method = PYRAMID;
+		}
+		if (i+1 < narg && arg[i+1][0] != '-') {
+			options.angular_resolution = std::stof(arg[++i]);
+		}
+	} else if (option == "--sensor" && i+1 < narg) {
+		std::string model(arg[++i]);
+		if (model == "field") {
+			options.sensor_model = LIKELIHOOD_FIELD;
+		}
+	} else if (option == "--layout" && i+1 < narg) {
+		std::string layout(arg[++i]);
+		if (layout == "tiled") {
+			options.map_layout = TILED;
+		}
+	} else if (option == "--reorder" && i+1 < narg) {
+		options.reorder_period = std::stoi(arg[++i]);
+	} else if (option == "--compress") {
+		options.compress_duplicates = true;
+	} else if (option == "--stationary") {
+		options.stationary_updates = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Filter of npart particles at most with the given options
+inline void configureFilter(ParticleFilter &pf, const FilterOptions &options, unsigned npart) {
+	pf.setResamplingMethod(options.resampling_method);
+	pf.setRayCastMethod(options.ray_cast_method, options.angular_resolution*M_PI/180.0f);
+	pf.setSensorModel(options.sensor_model);
+	pf.setMapLayout(options.map_layout);
+	pf.setSpatialReorder(options.reorder_period);
+	pf.setDuplicateCompression(options.compress_duplicates);
+
+	if (options.kld_sampling) {
+		pf.setKLDSampling(options.min_particles, npart);
+	}
+}
+
+// Copies the command and the ranges of a frame, which is only valid until the next message
+inline void decodeReading(const FrameView &frame, Reading &reading) {
+	reading.command = static_cast<Action>(frame.command());
+	const unsigned frame_beams = frame.beamCount();
+	const unsigned step = (frame_beams + MAX_BEAMS - 1)/MAX_BEAMS;
+	reading.nbeams = 0;
+	for (unsigned b=0; b<frame_beams; b+=step) {
+		reading.ranges[reading.nbeams++] = frame.range(b);
+	}
+	reading.angle_step = frame_beams > 0 ? 2.0f*M_PI*step/frame_beams : 0.0f;
+}
+
+// Whether any of the runs moves the robot
+inline bool hasMotion(const CommandRun *runs, unsigned nruns) {
+	for (unsigned r=0; r<nruns; ++r) {
+		if (runs[r].command != DO_NOTHING) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// One cycle of the filter: the motions of the runs in order, the reading (taken after all of them) and the
+// resampling. Returns false if the lidar reading was discarded as a probable reading error.
+// Without motion there is no noise to spread the copies made by a resampling again, so a cycle of stationary
+// readings (see --stationary) only weighs the particles
+inline bool runCycle(ParticleFilter &pf, const CommandRun *runs, unsigned nruns, const Reading &reading, CycleState &state) {
+
+	//Register movement based on command
+	unsigned coalesced = 0;
+	float coalesced_distance = 0.0f; // metres
+	bool coalesced_turns = false;
+	for (unsigned r=0; r<nruns; ++r) {
+		pf.move(runs[r].command, runs[r].steps);
+		coalesced += runs[r].steps;
+		if (runs[r].command == GO_FORWARD) {
+			coalesced_distance += runs[r].steps*SPEED_F*COMMAND_DURATION;
+		} else if (runs[r].command == GO_BACK) {
+			coalesced_distance += runs[r].steps*SPEED_B*COMMAND_DURATION;
+		} else if (runs[r].command != DO_NOTHING) {
+			coalesced_turns = true;
+		}
+	}
+	// The check of the reading below allows the change of range of a single command. When several were
+	// coalesced, the previous reading is older: the allowed change grows with the distance travelled since,
+	// and after several turns the range is not predictable at all
+	if (coalesced == 1) {
+		coalesced_distance = 0.0f;
+		coalesced_turns = false;
+	}
+
+	////Update pf and resample
+	bool used = true;
+	if (reading.nbeams > 1) {
+		// A scan: the filter drops the beams without a measurement or out of the range of the lidar
+		state.beams.clear();
+		for (unsigned b=0; b<reading.nbeams; ++b) {
+			const Beam beam = {b*reading.angle_step, reading.ranges[b], reading.ranges[b] > 0.0f ? 1u : 0u};
+			state.beams.push_back(beam);
+		}
+		pf.updateLikelihood(state.beams);
+	} else {
+		// If the lidar sensor gives value 0.0 or there is a huge change from the previous information
+		// there might have been an error with the read, so we will not use it
+		const float lidar_sensor_data = reading.nbeams > 0 ? reading.ranges[0] : 0.0f;
+		const float lidar_data_variation = std::abs(lidar_sensor_data-state.previous_lidar_sensor_data);
+		const float allowed_variation = state.previous_lidar_sensor_data*0.2f + coalesced_distance;
+		if(lidar_sensor_data == 0.0f || (lidar_data_variation > allowed_variation && !coalesced_turns)) {
+			pf.updateLikelihood();
+			used = false;
+		} else {
+			pf.updateLikelihood(lidar_sensor_data);
+		}
+		state.previous_lidar_sensor_data = lidar_sensor_data;
+	}
+
+	if (hasMotion(runs, nruns)) {
+		pf.resampleIfNeeded();
+	}
+	return used;
+}
+
+// Cycle of a single command
+inline bool runCycle(ParticleFilter &pf, const Reading &reading, CycleState &state) {
+	const CommandRun run = {reading.command, 1};
+	return runCycle(pf, &run, 1, reading, state);
+}
+
+#endif
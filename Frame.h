@@ -0,0 +1,82 @@
+// Binary message sent by the controller every cycle (see controller.py): a single ZMQ message with the command and
+// the lidar ranges read after it, so a command can never be paired with the reading of another message.
+// Fixed layout, little-endian, without padding:
+//   offset  bytes  field
+//    0       2     magic "PF"
+//    2       1     version (FRAME_VERSION)
+//    3       1     command, 0 to 4 (DO_NOTHING, GO_FORWARD, GO_BACK, TURN_LEFT, TURN_RIGHT)
+//    4       2     beam count n
+//    6       2     reserved, 0
+//    8       4     robot id
+//   12       4     sequence number, incremented by the sender for every frame
+//   16       8     timestamp of the reading, microseconds (clock of the sender)
+//   24      4*n    ranges, float metres. Beam i points 2*pi*i/n radians clockwise from the heading; 0 is no measurement
+// A FrameView decodes a frame where it was received, without copying it: it is valid until the next message.
+// The fields are read as little-endian, which is the byte order of the machines the filter runs on.
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+class FrameView {
+
+	private:
+		const unsigned char *data = nullptr;
+
+		template <class T>
+		T field(size_t offset) const {
+			T value;
+			std::memcpy(&value, data + offset, sizeof(T)); // the fields of a message need not be aligned
+			return value;
+		}
+
+	public:
+		static const unsigned char FRAME_VERSION = 1;
+		static const size_t HEADER_SIZE = 24;
+
+		// Points the view to the bytes of a message. Returns false, leaving the view invalid, if they are not a
+		// complete frame of this version
+		bool parse(const void *bytes, size_t size) {
+			data = static_cast<const unsigned char*>(bytes);
+			if (size < HEADER_SIZE || data[0] != 'P' || data[1] != 'F' || data[2] != FRAME_VERSION ||
+				size != HEADER_SIZE + beamCount()*sizeof(float)) {
+				data = nullptr;
+				return false;
+			}
+			return true;
+		}
+
+		bool valid() const {
+			return data != nullptr;
+		}
+
+		unsigned command() const {
+			return data[3];
+		}
+
+		unsigned beamCount() const {
+			return field<uint16_t>(4);
+		}
+
+		uint32_t robotId() const {
+			return field<uint32_t>(8);
+		}
+
+		uint32_t sequence() const {
+			return field<uint32_t>(12);
+		}
+
+		uint64_t timestamp() const {
+			return field<uint64_t>(16);
+		}
+
+		// Metres
+		float range(unsigned beam) const {
+			return field<float>(HEADER_SIZE + beam*sizeof(float));
+		}
+};
+
+#endif
@@ -0,0 +1,99 @@
+// KLD-sampling (Fox, "Adapting the sample size in particle filters through KLD-sampling", 2003).
+// The number of particles is chosen so that, with probability 1-delta, the Kullback-Leibler distance between
+// the particle approximation and the true posterior is lower than epsilon. It only depends on the number k
+// of (x, y, alpha) histogram bins covered by the belief: a spread belief needs many particles, a concentrated one few.
+// As in the paper, k counts the bins of the drawn samples, not of the weighted set they were drawn from.
+
+#ifndef KLD_SAMPLER_H
+#define KLD_SAMPLER_H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include "ParticleSet.h"
+
+class KLDSampler {
+
+	private:
+		unsigned min_particles;
+		unsigned max_particles;
+		float epsilon;
+		float z_quantile; // upper 1-delta quantile of the standard normal distribution
+		float bin_size_xy; // in cells
+		float bin_size_alpha; // in radians
+
+		std::vector<uint8_t> occupied_bins;
+
+	public:
+
+		KLDSampler(unsigned min_part = 1000, unsigned max_part = 100000,
+				   float eps = 0.05f, float z = 2.326f, // delta = 0.01
+				   float bin_xy = 10.0f, float bin_alpha = 10.0f*M_PI/180.0f):
+				   min_particles(min_part), max_particles(max_part),
+				   epsilon(eps), z_quantile(z),
+				   bin_size_xy(bin_xy), bin_size_alpha(bin_alpha) {}
+
+		void setBounds(unsigned min_part, unsigned max_part) {
+			min_particles = std::max(1u, min_part);
+			max_particles = std::max(min_particles, max_part);
+		}
+
+		void setError(float eps, float z) {
+			epsilon = eps;
+			z_quantile = z;
+		}
+
+		void setBinSize(float bin_xy, float bin_alpha) {
+			bin_size_xy = bin_xy;
+			bin_size_alpha = bin_alpha;
+		}
+
+		unsigned maxParticles() const {
+			return max_particles;
+		}
+
+		// Particles needed for a belief covering k bins, clamped to the configured bounds
+		unsigned requiredParticles(unsigned k) {
+			if (k < 2) {
+				return min_particles;
+			}
+
+			const double a = 2.0/(9.0*(k - 1));
+			const double b = 1.0 - a + std::sqrt(a)*z_quantile;
+			const double n = (k - 1)/(2.0*epsilon)*b*b*b;
+
+			return (unsigned)std::max<double>(min_particles, std::min<double>(max_particles, std::ceil(n)));
+		}
+
+		// Number of histogram bins covered by the n particles drawn from the set, given by their indices
+		unsigned occupiedBins(const ParticleSet &particles, const unsigned *indices, unsigned n,
+							  unsigned map_width, unsigned map_height) {
+			const unsigned nx = (unsigned)std::ceil(map_width/bin_size_xy) + 1;
+			const unsigned ny = (unsigned)std::ceil(map_height/bin_size_xy) + 1;
+			const unsigned nalpha = (unsigned)std::ceil(2.0f*M_PI/bin_size_alpha);
+			occupied_bins.assign((size_t)nx*ny*nalpha, 0);
+
+			unsigned k = 0;
+			for (unsigned j=0; j<n; ++j) {
+				const unsigned i = indices[j];
+				const unsigned bx = std::min(nx-1, (unsigned)std::max(0.0f, particles.x[i]/bin_size_xy));
+				const unsigned by = std::min(ny-1, (unsigned)std::max(0.0f, particles.y[i]/bin_size_xy));
+				const float alpha = particles.alpha[i] - 2.0f*M_PI*std::floor(particles.alpha[i]/(2.0f*M_PI));
+				const unsigned balpha = std::min(nalpha-1, (unsigned)(alpha/bin_size_alpha));
+
+				uint8_t &bin = occupied_bins[((size_t)by*nx + bx)*nalpha + balpha];
+				k += !bin;
+				bin = 1;
+			}
+
+			return k;
+		}
+
+		unsigned particleCount(const ParticleSet &particles, const unsigned *indices, unsigned n,
+							   unsigned map_width, unsigned map_height) {
+			return requiredParticles(occupiedBins(particles, indices, n, map_width, map_height));
+		}
+};
+
+#endif
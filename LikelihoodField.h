@@ -0,0 +1,46 @@
+// Likelihood field sensor model (Thrun, Burgard and Fox, "Probabilistic Robotics", 2005, section 6.4).
+// Instead of casting the expected ray, the lidar endpoint is projected from the particle pose and scored by its
+// distance to the closest wall: a Gaussian of that distance, mixed with a uniform term for unexplained readings.
+// The log-likelihood of every cell is precomputed from the distance field of the map, so a reading costs one lookup.
+
+#ifndef LIKELIHOOD_FIELD_H
+#define LIKELIHOOD_FIELD_H
+
+#include <eigen3/Eigen/Dense>
+#include <cmath>
+#include "Map.h"
+#include "DistanceTransform.h"
+
+enum SensorModel {
+	BEAM_MODEL,      // compares the reading with the range cast from the particle
+	LIKELIHOOD_FIELD // scores the distance from the projected endpoint to the closest wall
+};
+
+class LikelihoodField {
+
+	private:
+		CellMatrix log_likelihood; // per cell
+		float outside_log_likelihood; // endpoints outside the map only get the uniform term
+		
+	public:
+		// sigma is the standard deviation of the measurement noise in cells,
+		// random_weight the probability mass of the readings the map does not explain
+		LikelihoodField(const Map &map, float sigma, float random_weight = 0.05f) {
+			const CellMatrix distance = map.distance.size() > 0 ? map.distance : distanceField(map);
+			const float inv_two_var = 1.0f/(2.0f*sigma*sigma);
+			log_likelihood = ((1.0f - random_weight)*(-distance.array().square()*inv_two_var).exp() + random_weight).log().matrix();
+			outside_log_likelihood = std::log(random_weight);
+		}
+		
+		// Log-likelihood of a reading ending at (x,y), in cells. It is 0 on the walls
+		float logLikelihood(float x, float y) const {
+			const unsigned cell_x = (unsigned)x;
+			const unsigned cell_y = (unsigned)y;
+			if (x < 0.0f || y < 0.0f || cell_x >= log_likelihood.cols() || cell_y >= log_likelihood.rows()) {
+				return outside_log_likelihood;
+			}
+			return log_likelihood.data()[(size_t)cell_y*log_likelihood.cols() + cell_x];
+		}
+};
+
+#endif
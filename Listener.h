@@ -3,6 +3,7 @@
 
 #include <zmq.hpp>
 #include <unistd.h>
+#include "Frame.h"
 
 class Listener{
 	private:
@@ -11,8 +12,6 @@ class Listener{
 		zmq::message_t msg;
 	
 	public:
-		const std::string DO_NOTHING = "0";
-		
 		Listener(): context(1) {
 		
 			socket = zmq::socket_t(context, ZMQ_PULL);
@@ -28,22 +27,15 @@ class Listener{
 			
 		}
 		
-		std::string receive(bool wait=true) {
-		
-			if(!wait){
-				socket.recv(msg, zmq::recv_flags::dontwait);
-			}else{
-				try{
-					socket.recv(msg, zmq::recv_flags::none);
-				}catch(int e){
-					return DO_NOTHING;
-				}
+		// Receives the next message and decodes it into frame (see Frame.h), which is left invalid if the message is
+		// not a frame. The frame points to the received bytes: it is only valid until the next call, and nothing is
+		// copied or allocated. Without wait, returns false if there is no message
+		bool receiveFrame(FrameView &frame, bool wait=true) {
+			if (!socket.recv(msg, wait ? zmq::recv_flags::none : zmq::recv_flags::dontwait)) {
+				return false;
 			}
-			
-        	std::string msg_string = std::string(static_cast<char *>(msg.data()), msg.size());
-        	
-        	return msg_string;
-		
+			frame.parse(msg.data(), msg.size());
+			return true;
 		}
 };
 
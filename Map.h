@@ -1,19 +1,39 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include <eigen3/Eigen/Dense>
+#include <utility>
+#include "OccupancyGrid.h"
+
+// Value per cell, indexed (y, x) and stored row major like the cells of a row-major grid
+typedef Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> CellMatrix;
+
 struct Map {
-	Eigen::MatrixXi matrix;
+	OccupancyGrid grid;
+	CellMatrix distance; // distance (in cells) from each cell to the closest wall, see DistanceTransform.h
 	int margin;
 	int cellsPerMetre;
 	
 	Map() {}
 	
-	Map(Eigen::MatrixXi mat, int marg, int cpm): matrix(mat) {
+	// Pass the grid with std::move to avoid a copy. Components share maps through a MapHandle (see MapHandle.h)
+	Map(OccupancyGrid occupancy, int marg, int cpm): grid(std::move(occupancy)) {
 		margin = marg;
 		cellsPerMetre = cpm;
 	}
 	
-	Map(const Map& map): matrix(map.matrix), margin(map.margin), cellsPerMetre(map.cellsPerMetre) {}
+	// A position is valid if it is inside the map and not occupied
+	bool isFree(unsigned x, unsigned y) const {
+		return x<(unsigned)grid.width() && y<(unsigned)grid.height() && grid.at(x,y) == 0;
+	}
+	
+	int width() const {
+		return grid.width();
+	}
+	
+	int height() const {
+		return grid.height();
+	}
 	
 };
 
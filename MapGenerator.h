@@ -11,6 +11,7 @@
 #include "coord2D.h"
 #include "SceneElement.h"
 #include "Map.h"
+#include "MapHandle.h"
 #include "pugixml.hpp"
 
 class MapGenerator {
@@ -30,7 +31,8 @@ class MapGenerator {
 		int max_x = INT_MIN;
 		int max_y = INT_MIN;
 		
-		Eigen::MatrixXi map; 
+		OccupancyGrid map; // grid being drawn, moved into the generated map
+		MapHandle generated_map; 
 		
 		void update_scene_width_height(){
 			
@@ -73,34 +75,34 @@ class MapGenerator {
 				
 					int y = round(m*(x-x1) + y1);
 					//std::cout<<"x:"<<x<<" y:"<<y<<std::endl;
-					map(y,x) = 1;
+					map.at(x,y) = 1;
 				}
 		 	}else{
 		 		int sign = (y2 - y1)/abs(y2 - y1);
 		 		for (int y = y1; (y-y1)*sign <= (y2-y1)*sign; y+=sign) {
 		 			//std::cout<<"x:"<<x1<<" y:"<<y<<std::endl;
-					map(y,x1) = 1;
+					map.at(x1,y) = 1;
 				}
 		 	}
 			
 			
-			map(y2,x2) = 1;
+			map.at(x2,y2) = 1;
 		}
 		
 		// A recursive function to replace previous color 'prevC' at  '(x, y)'
 		// and all surrounding pixels of (x, y) with new color 'newC' and
-		void flood_fill_util(Eigen::MatrixXi &map, int x, int y, int prevC, int newC)
+		void flood_fill_util(OccupancyGrid &map, int x, int y, int prevC, int newC)
 		{
 			// Base cases
-			if (x < 0 || x >= map.cols() || y < 0 || y >= map.rows())
+			if (!map.inside(x, y))
 				return;
-			if (map(y,x) != prevC)
+			if (map.at(x,y) != prevC)
 				return;
-			if (map(y,x) == newC)
+			if (map.at(x,y) == newC)
 				return;
 		 
 			// Replace the color at (x, y)
-			map(y,x) = newC;
+			map.at(x,y) = newC;
 		 
 			// Recur for north, east, south and west
 			flood_fill_util(map, x+1, y, prevC, newC);
@@ -111,15 +113,21 @@ class MapGenerator {
 		 
 		// It mainly finds the previous color on (x, y) and
 		// calls flood_fill_util()
-		void flood_fill(Eigen::MatrixXi &map, int x, int y, int newC)
+		void flood_fill(OccupancyGrid &map, int x, int y, int newC)
 		{
-			int prevC = map(y,x);
+			int prevC = map.at(x,y);
 			
 			if(prevC==newC) return;
 			
 			flood_fill_util(map, x, y, prevC, newC);
 		}
-		
+
+		// The distance field and the other products are attached to the handle when something uses them
+		MapHandle build_map() {
+			generated_map = MapHandle(Map(std::move(map), margin, cellsPerMetre));
+			return generated_map;
+		}
+
 	public:
 
 		MapGenerator() {}
@@ -183,11 +191,11 @@ class MapGenerator {
 		}
 		
 		// Generates the map matrix
-		Map generateMap(){
+		MapHandle generateMap(){
 			
 			//std::cout<<"Height:"<<scene_height<<std::endl;
 			//std::cout<<"Width:"<<scene_width<<std::endl;
-			map = Eigen::MatrixXi::Zero(scene_height+2*margin, scene_width+2*margin);
+			map = OccupancyGrid(scene_width+2*margin, scene_height+2*margin);
 			
 			auto scene_coords = scene.getShapeCoords();
 			
@@ -205,17 +213,17 @@ class MapGenerator {
 			// Might not work if margin=0 (TODO: correct it)
 			flood_fill(map, 1, 1, 1);
 			
-			return Map(map, margin, cellsPerMetre);
+			return build_map();
 		}
 		
 		//TODO
-		// Adds the undrawn objects to the map
-		Map updateMap(){
-			return Map(map, margin, cellsPerMetre);
+		// Adds the undrawn objects to the map (to a copy of generated_map->grid, the drawn grid is not kept)
+		MapHandle updateMap(){
+			return generated_map;
 		}
 		
-		Map getMap(){
-			return Map(map, margin, cellsPerMetre);
+		MapHandle getMap(){
+			return generated_map;
 		}
 		
 };
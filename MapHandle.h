@@ -0,0 +1,171 @@
+// Shared, immutable map. Copies of a MapHandle reference the same Map and the same derived products (distance field,
+// ray casters, likelihood fields): each product is built on first use by whichever holder needs it and then reused
+// by all the others, so several filters, the plotter and the generator keep a single copy of the map in memory.
+// Products are built under a mutex, so filters running in different threads can share a handle. They stay valid
+// while any handle to the map exists.
+// A copy in another storage layout (see withLayout) only has its own layout-dependent ray casters (ray marching and
+// DDA): the other products do not depend on how the cells are stored, so they are taken from the original.
+
+#ifndef MAP_HANDLE_H
+#define MAP_HANDLE_H
+
+#include <eigen3/Eigen/Dense>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <utility>
+#include "Map.h"
+#include "RayCaster.h"
+#include "DDATraversal.h"
+#include "RangeTable.h"
+#include "CDDT.h"
+#include "SphereTracing.h"
+#include "PyramidTraversal.h"
+#include "DistanceTransform.h"
+#include "LikelihoodField.h"
+
+class MapHandle {
+
+	private:
+		struct Shared {
+			Map map; // only written while building the distance field, before anything reads it
+			std::mutex mutex;
+
+			RayMarching ray_marching;
+			DDATraversal dda;
+			SphereTracing sphere_tracing; // reads map.distance
+			std::map<std::pair<unsigned,float>, std::unique_ptr<RangeTable> > range_tables; // by (max range, resolution)
+			std::map<float, std::unique_ptr<CDDT> > cddts; // by resolution
+			std::unique_ptr<PyramidTraversal> pyramid;
+			std::map<float, std::unique_ptr<LikelihoodField> > likelihood_fields; // by sigma
+
+			// The same map in the other storage layout. The copy owns the original, which holds its products
+			std::shared_ptr<Shared> original;
+			std::weak_ptr<Shared> relayout;
+
+			Shared(Map &&user_map): map(std::move(user_map)), ray_marching(map), dda(map), sphere_tracing(map) {}
+
+			// Called with the mutex locked
+			void build_distance() {
+				if (map.distance.size() == 0) {
+					map.distance = ::distanceField(map);
+				}
+			}
+		};
+
+		std::shared_ptr<Shared> shared;
+
+		explicit MapHandle(const std::shared_ptr<Shared> &other): shared(other) {}
+
+		// Holder of the products that do not depend on the layout
+		Shared& products() const {
+			return shared->original ? *shared->original : *shared;
+		}
+
+	public:
+		MapHandle() {}
+
+		// Takes the map over (pass it with std::move to avoid a copy)
+		explicit MapHandle(Map map): shared(std::make_shared<Shared>(std::move(map))) {}
+
+		const Map& operator*() const {
+			return shared->map;
+		}
+
+		const Map* operator->() const {
+			return &shared->map;
+		}
+
+		// Number of handles referencing this map
+		long useCount() const {
+			return shared.use_count();
+		}
+
+		// The same map with its cells stored in the given layout. The copy is shared by every handle asking for it
+		// while one of them holds it
+		MapHandle withLayout(GridLayout layout) const {
+			if (shared->map.grid.layout() == layout) {
+				return *this;
+			}
+			const std::shared_ptr<Shared> original = shared->original ? shared->original : shared;
+			if (original->map.grid.layout() == layout) {
+				return MapHandle(original);
+			}
+			std::lock_guard<std::mutex> lock(original->mutex);
+			std::shared_ptr<Shared> relayout = original->relayout.lock();
+			if (!relayout) {
+				Map copy(original->map);
+				copy.grid.setLayout(layout);
+				copy.distance = CellMatrix(); // read from the original
+				relayout = std::make_shared<Shared>(std::move(copy));
+				relayout->original = original;
+				original->relayout = relayout;
+			}
+			return MapHandle(relayout);
+		}
+
+		// Distance (in cells) from each cell to the closest wall, see DistanceTransform.h
+		const CellMatrix& distanceField() const {
+			Shared &base = products();
+			std::lock_guard<std::mutex> lock(base.mutex);
+			base.build_distance();
+			return base.map.distance;
+		}
+
+		const RayCaster& rayMarching() const {
+			return shared->ray_marching;
+		}
+
+		const RayCaster& dda() const {
+			return shared->dda;
+		}
+
+		const RayCaster& sphereTracing() const {
+			distanceField();
+			return products().sphere_tracing;
+		}
+
+		// Ranges up to max_range cells, with the given angular resolution in radians
+		const RayCaster& rangeTable(unsigned max_range, float angular_resolution) const {
+			Shared &base = products();
+			std::lock_guard<std::mutex> lock(base.mutex);
+			std::unique_ptr<RangeTable> &table = base.range_tables[std::make_pair(max_range, angular_resolution)];
+			if (!table) {
+				table.reset(new RangeTable(base.map, base.dda, max_range, angular_resolution));
+			}
+			return *table;
+		}
+
+		const RayCaster& cddt(float angular_resolution) const {
+			Shared &base = products();
+			std::lock_guard<std::mutex> lock(base.mutex);
+			std::unique_ptr<CDDT> &cddt = base.cddts[angular_resolution];
+			if (!cddt) {
+				cddt.reset(new CDDT(base.map, angular_resolution));
+			}
+			return *cddt;
+		}
+
+		const RayCaster& pyramid() const {
+			Shared &base = products();
+			std::lock_guard<std::mutex> lock(base.mutex);
+			if (!base.pyramid) {
+				base.pyramid.reset(new PyramidTraversal(base.map));
+			}
+			return *base.pyramid;
+		}
+
+		// Likelihood field for a measurement noise of sigma cells
+		const LikelihoodField& likelihoodField(float sigma) const {
+			Shared &base = products();
+			std::lock_guard<std::mutex> lock(base.mutex);
+			std::unique_ptr<LikelihoodField> &field = base.likelihood_fields[sigma];
+			if (!field) {
+				base.build_distance();
+				field.reset(new LikelihoodField(base.map, sigma));
+			}
+			return *field;
+		}
+};
+
+#endif
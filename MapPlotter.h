@@ -7,17 +7,21 @@
 #include <iostream>
 #include <cmath>
 #include "Map.h"
+#include "MapHandle.h"
 #include "coord2D.h"
 
 class MapPlotter {
 
 	private:
-		Map map; 
+		MapHandle map; 
 		sf::RenderWindow window;
 		sf::Vector2u winSize;
 		unsigned cellSize;
 		std::vector<sf::Texture> robotTextures; // We need to keep the textures so they do not get deleted
 		std::vector<sf::Sprite> robotSprites;
+		// Shapes reused for every cell and particle, instead of building one per draw
+		sf::RectangleShape cellShape;
+		sf::CircleShape particleShape;
 		
 		void load_robot_images(const std::vector<std::string> &paths){
 			for(auto path : paths){
@@ -43,8 +47,8 @@ class MapPlotter {
 			for(int i = 0; i < size; ++i){
 				
 				// Set the position of the sprite centered in the window
-				robotSprites[i].setPosition( (map.margin + coords[i].x + (winSize.x/cellSize-map.matrix.cols())/2) * cellSize, 
-											 (map.margin + coords[i].y + (winSize.y/cellSize-map.matrix.rows())/2) * cellSize );
+				robotSprites[i].setPosition( (map->margin + coords[i].x + ((int)(winSize.x/cellSize)-map->width())/2) * cellSize, 
+											 (map->margin + coords[i].y + ((int)(winSize.y/cellSize)-map->height())/2) * cellSize );
 				//robotSprites[i].setPosition( coords[i].x, 
 				//							 coords[i].y );
 				
@@ -60,20 +64,19 @@ class MapPlotter {
 		}	
 		
 		void draw_cells(){
-			for (int i = 0; i < map.matrix.rows(); ++i) {
-				for (int j = 0; j < map.matrix.cols(); ++j) {
-				    sf::RectangleShape cell(sf::Vector2f(cellSize, cellSize));
+			for (int i = 0; i < map->height(); ++i) {
+				for (int j = 0; j < map->width(); ++j) {
 				    // Set the position of the sprite centered in the window
-				    cell.setPosition( (j + (winSize.x/cellSize-map.matrix.cols())/2) * cellSize, 
-				    				  (i + (winSize.y/cellSize-map.matrix.rows())/2) * cellSize );
+				    cellShape.setPosition( (j + ((int)(winSize.x/cellSize)-map->width())/2) * cellSize, 
+				    				  (i + ((int)(winSize.y/cellSize)-map->height())/2) * cellSize );
 					//cell.setPosition( j * cellSize, 
 				    //				  i * cellSize );
-				    if (map.matrix(i, j) == 1) {
-				        cell.setFillColor(sf::Color::Black);
+				    if (map->grid.at(j, i) == 1) {
+				        cellShape.setFillColor(sf::Color::Black);
 				    } else {
-				        cell.setFillColor(sf::Color::White);
+				        cellShape.setFillColor(sf::Color::White);
 				    }
-				    window.draw(cell);
+				    window.draw(cellShape);
 				}
 			}
 		}
@@ -101,14 +104,14 @@ class MapPlotter {
 		
 	public:
 
-		MapPlotter(const Map &map_matrix,
+		MapPlotter(const MapHandle &map_handle,
 				   const int window_width, const int window_height, 
 				   const unsigned cell_size,
 				   const std::vector<std::string> &robot_imgs_paths = {}
-				  ) : map(), window(sf::VideoMode(window_width, window_height), "Map"){
+				  ) : map(map_handle), window(sf::VideoMode(window_width, window_height), "Map"){
 							  
-			map = map_matrix;
 			cellSize = cell_size;
+			cellShape.setSize(sf::Vector2f(cellSize, cellSize));
 			winSize = window.getSize();
 			load_robot_images(robot_imgs_paths);
 		}
@@ -139,14 +142,19 @@ class MapPlotter {
 		}
 		
 		void drawCircle(coord2D coord, int opacity=255, float size=5.0f, sf::Color color=sf::Color::Blue){
-/*			sf::CircleShape circle(size);*/
-			sf::CircleShape circle(opacity/20.0f);
+/*			particleShape.setRadius(size);*/
+			particleShape.setRadius(opacity/20.0f);
 			color.a = opacity;
-			circle.setFillColor(color);
-			circle.setPosition( (map.margin + coord.x + (winSize.x/cellSize-map.matrix.cols())/2) * cellSize,
-							    (map.margin + coord.y + (winSize.y/cellSize-map.matrix.rows())/2) * cellSize );
+			particleShape.setFillColor(color);
+			particleShape.setPosition( (map->margin + coord.x + ((int)(winSize.x/cellSize)-map->width())/2) * cellSize,
+							    (map->margin + coord.y + ((int)(winSize.y/cellSize)-map->height())/2) * cellSize );
 							   
-			window.draw(circle);
+			window.draw(particleShape);
+		}
+		
+		// update() waits so the window is not redrawn more often than this
+		void setFramerateLimit(unsigned fps) {
+			window.setFramerateLimit(fps);
 		}
 		
 		void update() {
@@ -0,0 +1,90 @@
+// Motion update kernels working on the structure of arrays of ParticleSet.
+// The deviations are sampled beforehand, so the kernels only do arithmetic and can process 8 particles per iteration.
+
+#ifndef MOTION_MODEL_H
+#define MOTION_MODEL_H
+
+#include <cmath>
+#include "Simd.h"
+
+namespace motion {
+
+	// Moves every particle along its heading:
+	// dx = ((speed + dev_along)*cos(alpha) - dev_across*sin(alpha))*scale
+	// dy = ((speed + dev_along)*sin(alpha) + dev_across*cos(alpha))*scale
+	inline void translate_scalar(float *x, float *y, const float *alpha,
+								 const float *dev_along, const float *dev_across,
+								 unsigned begin, unsigned end, float speed, float scale) {
+		for (unsigned i=begin; i<end; ++i) {
+			const float c = cos(alpha[i]);
+			const float s = sin(alpha[i]);
+			const float v = speed + dev_along[i];
+			x[i] += (v*c - dev_across[i]*s)*scale;
+			y[i] += (v*s + dev_across[i]*c)*scale;
+		}
+	}
+
+	SIMD_AVX2 inline void translate_avx2(float *x, float *y, const float *alpha,
+										 const float *dev_along, const float *dev_across,
+										 unsigned begin, unsigned end, float speed, float scale) {
+		const __m256 v_speed = _mm256_set1_ps(speed);
+		const __m256 v_scale = _mm256_set1_ps(scale);
+		unsigned i = begin;
+		for (; i+8<=end; i+=8) {
+			__m256 s, c;
+			simd::sincos_ps(_mm256_loadu_ps(alpha+i), &s, &c);
+			const __m256 v = _mm256_add_ps(v_speed, _mm256_loadu_ps(dev_along+i));
+			const __m256 across = _mm256_loadu_ps(dev_across+i);
+			const __m256 dx = _mm256_fmsub_ps(v, c, _mm256_mul_ps(across, s));
+			const __m256 dy = _mm256_fmadd_ps(v, s, _mm256_mul_ps(across, c));
+			_mm256_storeu_ps(x+i, _mm256_fmadd_ps(dx, v_scale, _mm256_loadu_ps(x+i)));
+			_mm256_storeu_ps(y+i, _mm256_fmadd_ps(dy, v_scale, _mm256_loadu_ps(y+i)));
+		}
+		translate_scalar(x, y, alpha, dev_along, dev_across, i, end, speed, scale);
+	}
+
+	inline void translate(float *x, float *y, const float *alpha,
+						  const float *dev_along, const float *dev_across,
+						  unsigned begin, unsigned end, float speed, float scale) {
+		if (cpuHasAVX2()) {
+			translate_avx2(x, y, alpha, dev_along, dev_across, begin, end, speed, scale);
+		} else {
+			translate_scalar(x, y, alpha, dev_along, dev_across, begin, end, speed, scale);
+		}
+	}
+
+	// Turns every particle: alpha += (speed + dev)*scale, wrapped to [0, 2*Pi)
+	// (wrapping keeps the angles in the range where the vectorized sincos is accurate)
+	inline void rotate_scalar(float *alpha, const float *dev, unsigned begin, unsigned end, float speed, float scale) {
+		const float TWO_PI = 2.0f*M_PI;
+		for (unsigned i=begin; i<end; ++i) {
+			const float a = alpha[i] + (speed + dev[i])*scale;
+			alpha[i] = a - TWO_PI*std::floor(a/TWO_PI);
+		}
+	}
+
+	SIMD_AVX2 inline void rotate_avx2(float *alpha, const float *dev, unsigned begin, unsigned end, float speed, float scale) {
+		const __m256 v_speed = _mm256_set1_ps(speed);
+		const __m256 v_scale = _mm256_set1_ps(scale);
+		const __m256 two_pi = _mm256_set1_ps(2.0f*M_PI);
+		const __m256 inv_two_pi = _mm256_set1_ps(1.0f/(2.0f*M_PI));
+		unsigned i = begin;
+		for (; i+8<=end; i+=8) {
+			const __m256 a = _mm256_fmadd_ps(_mm256_add_ps(v_speed, _mm256_loadu_ps(dev+i)), v_scale, _mm256_loadu_ps(alpha+i));
+			const __m256 turns = _mm256_floor_ps(_mm256_mul_ps(a, inv_two_pi));
+			_mm256_storeu_ps(alpha+i, _mm256_fnmadd_ps(turns, two_pi, a));
+		}
+		rotate_scalar(alpha, dev, i, end, speed, scale);
+	}
+
+	inline void rotate(float *alpha, const float *dev, unsigned begin, unsigned end, float speed, float scale) {
+		if (cpuHasAVX2()) {
+			rotate_avx2(alpha, dev, begin, end, speed, scale);
+		} else {
+			rotate_scalar(alpha, dev, begin, end, speed, scale);
+		}
+	}
+
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Occupancy of the map cells, one byte per cell (0 free, 1 occupied), surrounded by a guard border of occupied cells:
+// code that moves at most one cell at a time from a cell inside the grid always meets an occupied cell before it
+// could leave the allocation, so it needs no bounds checks.
+// Two storage layouts are available:
+//  - ROW_MAJOR: rows one after the other, each padded to a multiple of a cache line.
+//  - TILED: 8x8 tiles of one cache line each, with the tiles in Z-order (Morton order), so cells that are close
+//    in 2D are close in memory whatever the direction. The Z-order runs over a square of a power of two tiles.
+
+#ifndef OCCUPANCY_GRID_H
+#define OCCUPANCY_GRID_H
+
+#include <stdint.h>
+#include <cstddef>
+#include "AlignedAllocator.h"
+
+enum GridLayout {
+	ROW_MAJOR,
+	TILED
+};
+
+class OccupancyGrid {
+
+	public:
+		static const int BORDER = 1; // width of the guard border, in cells
+		static const int CACHE_LINE = 64;
+		static const int TILE_SHIFT = 3; // tiles of 8x8 cells
+		static const int TILE_MASK = (1 << TILE_SHIFT) - 1;
+
+	private:
+		int grid_width;
+		int grid_height;
+		GridLayout grid_layout;
+		int row_stride; // ROW_MAJOR: bytes between the starts of two consecutive rows
+		size_t origin; // ROW_MAJOR: position of cell (0,0) in the storage
+		aligned_vector<uint8_t> storage;
+
+		// Inserts a 0 bit before each of the 16 lowest bits of v
+		static uint32_t spread_bits(uint32_t v) {
+			v &= 0xFFFF;
+			v = (v | (v << 8)) & 0x00FF00FF;
+			v = (v | (v << 4)) & 0x0F0F0F0F;
+			v = (v | (v << 2)) & 0x33333333;
+			v = (v | (v << 1)) & 0x55555555;
+			return v;
+		}
+
+		void allocate() {
+			if (grid_layout == ROW_MAJOR) {
+				row_stride = (grid_width + 2*BORDER + CACHE_LINE - 1)/CACHE_LINE*CACHE_LINE;
+				origin = (size_t)BORDER*row_stride + BORDER;
+				// A cache line of padding at the end, so vector loads of the last cells stay inside the allocation
+				storage.assign((size_t)(grid_height + 2*BORDER)*row_stride + CACHE_LINE, 1);
+			} else {
+				const int tiles_x = (grid_width + 2*BORDER + TILE_MASK) >> TILE_SHIFT;
+				const int tiles_y = (grid_height + 2*BORDER + TILE_MASK) >> TILE_SHIFT;
+				int side = 1;
+				while (side < tiles_x || side < tiles_y) {
+					side *= 2;
+				}
+				row_stride = 0;
+				origin = 0;
+				storage.assign((size_t)side*side << (2*TILE_SHIFT), 1);
+			}
+		}
+
+	public:
+		OccupancyGrid(int width = 0, int height = 0, GridLayout layout = ROW_MAJOR):
+					  grid_width(width), grid_height(height), grid_layout(layout) {
+			allocate();
+			for (int y=0; y<height; ++y) {
+				for (int x=0; x<width; ++x) {
+					at(x, y) = 0;
+				}
+			}
+		}
+
+		// Moves the cells to the given layout
+		void setLayout(GridLayout layout) {
+			if (layout == grid_layout) {
+				return;
+			}
+			OccupancyGrid other(grid_width, grid_height, layout);
+			for (int y=0; y<grid_height; ++y) {
+				for (int x=0; x<grid_width; ++x) {
+					other.at(x, y) = at(x, y);
+				}
+			}
+			*this = other;
+		}
+
+		GridLayout layout() const {
+			return grid_layout;
+		}
+
+		int width() const {
+			return grid_width;
+		}
+
+		int height() const {
+			return grid_height;
+		}
+
+		bool inside(int x, int y) const {
+			return (unsigned)x < (unsigned)grid_width && (unsigned)y < (unsigned)grid_height;
+		}
+
+		// Position of cell (x,y) in the storage with each layout
+		size_t rowMajorOffset(int x, int y) const {
+			return origin + (ptrdiff_t)y*row_stride + x;
+		}
+
+		size_t tiledOffset(int x, int y) const {
+			const unsigned u = x + BORDER;
+			const unsigned v = y + BORDER;
+			const size_t tile = spread_bits(u >> TILE_SHIFT) | (spread_bits(v >> TILE_SHIFT) << 1);
+			return (tile << (2*TILE_SHIFT)) | ((v & TILE_MASK) << TILE_SHIFT) | (u & TILE_MASK);
+		}
+
+		size_t offset(int x, int y) const {
+			return grid_layout == ROW_MAJOR ? rowMajorOffset(x, y) : tiledOffset(x, y);
+		}
+
+		// Cell (x,y), for x in [-BORDER, width+BORDER) and y in [-BORDER, height+BORDER)
+		uint8_t& at(int x, int y) {
+			return storage[offset(x, y)];
+		}
+
+		uint8_t at(int x, int y) const {
+			return storage[offset(x, y)];
+		}
+
+		// Raw storage, indexed with rowMajorOffset() or tiledOffset() depending on the layout
+		const uint8_t* data() const {
+			return storage.data();
+		}
+
+		// ROW_MAJOR only: pointer to cell (0,0). Cell (x,y) is at offset y*stride() + x, also for the cells of the border
+		const uint8_t* cells() const {
+			return storage.data() + origin;
+		}
+
+		int stride() const {
+			return row_stride;
+		}
+
+		size_t memoryUsage() const {
+			return storage.size();
+		}
+};
+
+#endif
@@ -0,0 +1,81 @@
+// Max-pooled occupancy pyramid of a map. Level 0 marks the cells that are not free (see Map::isFree),
+// and each cell of level k covers a 2x2 block of level k-1, so it is empty only if its whole 2^k x 2^k block of the map is.
+
+#ifndef OCCUPANCY_PYRAMID_H
+#define OCCUPANCY_PYRAMID_H
+
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
+#include "Map.h"
+
+class OccupancyPyramid {
+
+	private:
+		struct Level {
+			unsigned width;
+			unsigned height;
+			std::vector<uint8_t> cells; // row major
+		};
+		
+		std::vector<Level> levels;
+		
+	public:
+		// Pools until the top level is a single cell, or until max_levels levels
+		OccupancyPyramid(const Map &map, unsigned max_levels = 16) {
+			Level base;
+			base.width = map.width();
+			base.height = map.height();
+			base.cells.resize((size_t)base.width*base.height);
+			for (unsigned y=0; y<base.height; ++y) {
+				for (unsigned x=0; x<base.width; ++x) {
+					base.cells[(size_t)y*base.width + x] = !map.isFree(x, y);
+				}
+			}
+			levels.push_back(base);
+			
+			while (levels.size() < max_levels && (levels.back().width > 1 || levels.back().height > 1)) {
+				const Level &fine = levels.back();
+				Level coarse;
+				coarse.width = (fine.width + 1)/2;
+				coarse.height = (fine.height + 1)/2;
+				coarse.cells.assign((size_t)coarse.width*coarse.height, 0);
+				for (unsigned y=0; y<fine.height; ++y) {
+					for (unsigned x=0; x<fine.width; ++x) {
+						uint8_t &cell = coarse.cells[(size_t)(y/2)*coarse.width + x/2];
+						cell = std::max(cell, fine.cells[(size_t)y*fine.width + x]);
+					}
+				}
+				levels.push_back(coarse);
+			}
+		}
+		
+		unsigned numLevels() const {
+			return levels.size();
+		}
+		
+		unsigned width() const {
+			return levels[0].width;
+		}
+		
+		unsigned height() const {
+			return levels[0].height;
+		}
+		
+		// Whether the block of level 'level' that contains the map cell (x,y) has any occupied cell.
+		// (x,y) must be inside the map
+		bool occupied(unsigned level, unsigned x, unsigned y) const {
+			const Level &l = levels[level];
+			return l.cells[(size_t)(y >> level)*l.width + (x >> level)] != 0;
+		}
+		
+		size_t memoryUsage() const {
+			size_t bytes = 0;
+			for (const Level &l : levels) {
+				bytes += l.cells.size();
+			}
+			return bytes;
+		}
+};
+
+#endif
@@ -8,7 +8,20 @@
 #include <random>
 #include <cmath>
 #include <omp.h>
+#include <algorithm>
+#include <stdint.h>
+#include <climits>
 #include "coord2D.h"
+#include "ParticleSet.h"
+#include "MotionModel.h"
+#include "CounterRNG.h"
+#include "Resampler.h"
+#include "KLDSampler.h"
+#include "RayCaster.h"
+#include "LikelihoodField.h"
+#include "MapHandle.h"
+#include "SpatialSort.h"
+#include <memory>
 
 class RNGenerator {
 
@@ -25,6 +38,10 @@ class RNGenerator {
 			return dis(gen);
 		}
 		
+		uint64_t generateSeed() {
+			return ((uint64_t)gen() << 32) | gen();
+		}
+		
 		float generateFloat(float min, float max) {
 			std::uniform_real_distribution<> dis(min, max);
 			return dis(gen);
@@ -35,6 +52,16 @@ class RNGenerator {
 			return nd(gen);
 		}
 		
+		// Logarithm of probabilityPointNormalDistribution, without underflowing to -inf in the tails
+		float logProbabilityPointNormalDistribution(float x, float mean, float std) {
+			const double z = std::abs(x - mean) / (std * std::sqrt(2.0));
+			if (z < 20.0) {
+				return std::log(std::erfc(z));
+			}
+			// Asymptotic expansion of erfc for large z
+			return -z*z - std::log(z*std::sqrt(M_PI));
+		}
+		
 		// Returns the probability in [0,1] for a value as extreme as x on coming from a normal distribution with given parameters
 		float probabilityPointNormalDistribution(float x, float mean, float std) {
 			std::normal_distribution<> nd(mean, std);
@@ -46,19 +73,6 @@ class RNGenerator {
 				return 2*(1.0f-cdf);
 			}
 		}
-		
-		std::vector<unsigned> generateNFromDiscreteDistribution(unsigned n, const std::vector<float> &weights) {
-			std::discrete_distribution<> dd(weights.begin(), weights.end());
-			std::vector<unsigned> sample;
-			sample.reserve(n);
-			for(int i=0; i<n; ++i){
-				unsigned x = dd(gen);
-/*				std::cout<<"Sampled element weight: "<<weights[x]<<std::endl;*/
-				sample.push_back(x);
-			}
-			
-			return sample;
-		}
 };
 
 enum Action {
@@ -69,32 +83,77 @@ enum Action {
 	TURN_RIGHT
 };
 
-struct particle {
-	floatCoord2D coord;
-	float alpha;
-	float likelihood = 1.0;
-	
-	particle(): coord(0.0f,0.0f) {
-		alpha = 0.0f;
-	}
-	
-	particle(float x, float y, float angle): coord(x,y) {
-		alpha = angle;
-	}
+// One measurement of a lidar scan
+struct Beam {
+	float angle;      // radians, clockwise from the heading of the robot (positive angles turn like TURN_RIGHT)
+	float range;      // metres
+	unsigned quality; // reported by the lidar, 0 for invalid measurements
 };
 
 class ParticleFilter {
 	
 	private:
 		// State variables (position and movement direction)
-		std::vector<particle> particles;
+		ParticleSet particles;
 		
-		// Map
-		Map map; 
+		// Sampled deviations of the motion model
+		aligned_vector<float> deviation_a;
+		aligned_vector<float> deviation_b;
+		
+		// Map, shared with the other filters and components (see MapHandle)
+		MapHandle map; 
+		
+		// Ray casting backend of the sensor model, owned by the map
+		RayCastMethod ray_cast_method = DDA;
+		float ray_cast_resolution = M_PI/180.0f;
+		const RayCaster *ray_caster;
+		
+		// Sensor model
+		SensorModel sensor_model = BEAM_MODEL;
+		const LikelihoodField *likelihood_field = nullptr;
+		
+		// Beams of the last scan used by the update (angles relative to the heading, ranges in cells)
+		unsigned beam_step = 1; // uses one beam out of beam_step
+		unsigned min_beam_quality = 1;
+		aligned_vector<float> beam_angles;
+		aligned_vector<float> beam_ranges;
+		aligned_vector<float> simulated_ranges; // expected reading of each particle
+		static const unsigned RAY_BATCH = 64; // particles whose rays are cast together for each beam
 		
 		// Random number generator
 		RNGenerator rng;
 		
+		// Counter-based generator for the motion model. Each move() uses its own streams (numbered by motion_step),
+		// so the sampled deviations do not depend on the number of threads
+		CounterRNG motion_rng;
+		uint64_t motion_step = 0;
+		
+		unsigned num_threads = 5;
+		
+		// Resampling scheme and its preallocated buffers
+		Resampler resampler;
+		std::vector<float> weights;
+		std::vector<unsigned> new_particle_indices;
+		ParticleSet new_particles;
+		float resample_threshold = 0.5f;
+		
+		// Periodic reordering of the particles along a Hilbert curve (see SpatialSort)
+		SpatialSort spatial_sort;
+		unsigned spatial_reorder_period = 0; // in resamples, 0 disables it
+		unsigned resamples_since_reorder = 0;
+		
+		// Duplicate compression: after a resampling every distinct particle is stored once, with its number of copies,
+		// until the next motion gives each copy its own noise. The updates in between score every distinct pose once
+		bool compress_duplicates = false;
+		std::vector<unsigned> multiplicity; // copies of each stored particle, empty when every particle is stored once
+		unsigned total_particles; // counting the copies
+		
+		// Adaptive number of particles
+		const unsigned NOMINAL_PARTICLES; // used when KLD-sampling is disabled
+		bool kld_sampling = false;
+		KLDSampler kld;
+		unsigned particle_budget = UINT_MAX; // upper bound set from the cycle time (see DeadlineController)
+		
 		//// MODEL PARAMETERS
 		// Speed
 		const float SPEED_F; //going forward
@@ -115,110 +174,191 @@ class ParticleFilter {
 		const float LIDAR_MIN;
 		const float LIDAR_MAX;
 		
-		void go_forward(particle& p) {
-			const float DEVIATION_X = rng.generateNormal(0.0f, S_X_F);
-			const float DEVIATION_Y = rng.generateNormal(0.0f, S_Y_F);
-			
-			const float dx = ((SPEED_F+DEVIATION_X)*cos(p.alpha) + DEVIATION_Y*cos(p.alpha+M_PI/2.0f))*COMMAND_DURATION*map.cellsPerMetre;
-			const float dy = ((SPEED_F+DEVIATION_X)*sin(p.alpha) + DEVIATION_Y*sin(p.alpha+M_PI/2.0f))*COMMAND_DURATION*map.cellsPerMetre;
-
-/*			const float dx = SPEED_F*cos(p.alpha)*COMMAND_DURATION*map.cellsPerMetre;*/
-/*			const float dy = SPEED_F*sin(p.alpha)*COMMAND_DURATION*map.cellsPerMetre;*/
-			
-/*			std::cout << "dx:" << dx << " dy:" << dy << std::endl;*/
-			
-			p.coord.x += dx;
-			p.coord.y += dy;
+		// Range of particles handled by the calling thread inside a parallel region.
+		// Ranges start at multiples of 32 so the random streams are split at the same positions as in a serial run
+		void thread_range(unsigned npart, unsigned &begin, unsigned &end) {
+			const unsigned ALIGN = 32;
+			const unsigned nthreads = omp_get_num_threads();
+			const unsigned nblocks = (npart + ALIGN - 1)/ALIGN;
+			const unsigned blocks_per_thread = (nblocks + nthreads - 1)/nthreads;
+			begin = std::min(omp_get_thread_num()*blocks_per_thread*ALIGN, npart);
+			end = std::min(begin + blocks_per_thread*ALIGN, npart);
 		}
 		
-		void go_back(particle& p) {
-			const float DEVIATION_X = rng.generateNormal(0.0f, S_X_B);
-			const float DEVIATION_Y = rng.generateNormal(0.0f, S_Y_B);
-			
-			const float dx = -((SPEED_B+DEVIATION_X)*cos(p.alpha) + DEVIATION_Y*cos(p.alpha+M_PI/2.0f))*COMMAND_DURATION*map.cellsPerMetre;
-			const float dy = -((SPEED_B+DEVIATION_X)*sin(p.alpha) + DEVIATION_Y*sin(p.alpha+M_PI/2.0f))*COMMAND_DURATION*map.cellsPerMetre;
-
-/*			const float dx = -SPEED_B*cos(p.alpha)*COMMAND_DURATION*map.cellsPerMetre;*/
-/*			const float dy = -SPEED_B*sin(p.alpha)*COMMAND_DURATION*map.cellsPerMetre;*/
-			
-/*			std::cout << "dx:" << dx << " dy:" << dy << std::endl;*/
-			
-			p.coord.x += dx;
-			p.coord.y += dy;
+		// Forward (direction=1) or backward (direction=-1) motion with deviations along and across the heading,
+		// for steps consecutive commands (see move())
+		void translate(float speed, float s_along, float s_across, float direction, unsigned steps) {
+			// The deviations of the steps add up: the total one grows with sqrt(steps) while the duration grows with steps
+			const float noise_scale = 1.0f/std::sqrt((float)steps);
+			const unsigned npart = particles.size();
+			const uint64_t stream = motion_step++ << 1;
+			deviation_a.resize(npart);
+			deviation_b.resize(npart);
+			#pragma omp parallel num_threads(num_threads)
+			{
+				unsigned begin, end;
+				thread_range(npart, begin, end);
+				motion_rng.generateNormals(deviation_a.data(), stream, begin, end, 0.0f, s_along*noise_scale);
+				motion_rng.generateNormals(deviation_b.data(), stream | 1, begin, end, 0.0f, s_across*noise_scale);
+				motion::translate(particles.x.data(), particles.y.data(), particles.alpha.data(),
+								  deviation_a.data(), deviation_b.data(), begin, end,
+								  speed, direction*steps*COMMAND_DURATION*map->cellsPerMetre);
+			}
 		}
 		
-		void turn_left(particle& p) {
-			const float DEVIATION_ALPHA = rng.generateNormal(0.0f, S_ALPHA);
-			const float dalpha = -(SPEED_R+DEVIATION_ALPHA)*COMMAND_DURATION;
-/*			std::cout << "dalpha:" << dalpha << std::endl;*/
-			p.alpha += dalpha;
+		// Left (direction=-1) or right (direction=1) turn, for steps consecutive commands
+		void rotate(float direction, unsigned steps) {
+			const float noise_scale = 1.0f/std::sqrt((float)steps);
+			const unsigned npart = particles.size();
+			const uint64_t stream = motion_step++ << 1;
+			deviation_a.resize(npart);
+			#pragma omp parallel num_threads(num_threads)
+			{
+				unsigned begin, end;
+				thread_range(npart, begin, end);
+				motion_rng.generateNormals(deviation_a.data(), stream, begin, end, 0.0f, S_ALPHA*noise_scale);
+				motion::rotate(particles.alpha.data(), deviation_a.data(), begin, end, SPEED_R, direction*steps*COMMAND_DURATION);
+			}
 		}
 		
-		void turn_right(particle& p) {
-			const float DEVIATION_ALPHA = rng.generateNormal(0.0f, S_ALPHA);
-			const float dalpha = (SPEED_R+DEVIATION_ALPHA)*COMMAND_DURATION;
-/*			std::cout << "dalpha:" << dalpha << std::endl;*/
-			p.alpha += dalpha;
+		void go_forward(unsigned steps) {
+			translate(SPEED_F, S_X_F, S_Y_F, 1.0f, steps);
+		}
+		
+		void go_back(unsigned steps) {
+			translate(SPEED_B, S_X_B, S_Y_B, -1.0f, steps);
+		}
+		
+		void turn_left(unsigned steps) {
+			rotate(-1.0f, steps);
+		}
+		
+		void turn_right(unsigned steps) {
+			rotate(1.0f, steps);
 		}
 		
 		bool valid_position(unsigned x, unsigned y) {
-/*			std::cout << "Map value:" << map.matrix(y,x) << std::endl;*/
-			return  x>0 && y>0 && x<map.matrix.cols() && y<map.matrix.rows() && map.matrix(y,x) == 0;
-		}
-		
-		// Distance in the map from the particle to the closest wall in the moving direction 
-		int calculate_simulation_distance(particle p, unsigned horizon_length) {
-			unsigned x = (unsigned) p.coord.x;
-			unsigned y = (unsigned) p.coord.y;
-			const float dx = cos(p.alpha);
-			const float dy = sin(p.alpha); 
-			for (int i=2; (i*i*dx*dx+i*i*dy*dy)<(horizon_length*horizon_length); i+=2) {
-				unsigned x_i = (unsigned)(x+i*dx);
-				unsigned y_i = (unsigned)(y+i*dy);
-				if(!valid_position(x_i, y_i)) {
-					//std::cout << "Distance in map:" << (int)sqrt(i*i*dx*dx+i*i*dy*dy) << std::endl;
-					return (int)sqrt(i*i*dx*dx+i*i*dy*dy);
-				} 
+/*			std::cout << "Map value:" << (int)map->grid.at(x,y) << std::endl;*/
+			return map->isFree(x, y);
+		}
+		
+		// Distance in the map from the particle to the closest wall in the moving direction (-1 if there is none in the horizon)
+		float calculate_simulation_distance(unsigned i, unsigned horizon_length) {
+			return ray_caster->range(particles.x[i], particles.y[i], particles.alpha[i], horizon_length);
+		}
+		
+		bool valid_particle(unsigned i) {
+			return valid_position((unsigned) particles.x[i], (unsigned) particles.y[i]);
+		}
+		
+		// Discards a particle (likelihood 0)
+		void discard(unsigned i) {
+			particles.log_weight[i] = -INFINITY;
+		}
+		
+		// Capacity of all the per-particle buffers, so the filter does not allocate while it has at most npart particles
+		void reserve_buffers(unsigned npart) {
+			particles.reserve(npart);
+			new_particles.reserve(npart);
+			deviation_a.reserve(npart);
+			deviation_b.reserve(npart);
+			simulated_ranges.reserve(npart);
+			weights.reserve(npart);
+			new_particle_indices.reserve(npart);
+			multiplicity.reserve(npart);
+			resampler.reserve(npart);
+		}
+		
+		// Stores every copy of a compressed set separately
+		void expand_duplicates() {
+			if (multiplicity.empty()) {
+				return;
+			}
+			new_particle_indices.clear();
+			new_particle_indices.reserve(total_particles);
+			for (unsigned i=0; i<multiplicity.size(); ++i) {
+				new_particle_indices.insert(new_particle_indices.end(), multiplicity[i], i);
+			}
+			gather(new_particle_indices.data(), total_particles);
+			multiplicity.clear();
+		}
+		
+		// Replaces the particles by particles[indices[0..n)]
+		void gather(const unsigned *indices, unsigned n) {
+			new_particles.resize(n);
+			#pragma omp parallel for num_threads(num_threads)
+			for(int i=0; i<(int)n; ++i) {
+				new_particles.copy(i, particles, indices[i]);
+			}
+			particles.swap(new_particles);
+		}
+		
+		// Subtracts the maximum log-weight, so the best particle has likelihood 1 and the others never underflow together
+		void normalize_weights() {
+			const int npart = particles.size();
+			float max_log_weight = -INFINITY;
+			#pragma omp parallel for num_threads(num_threads) reduction(max:max_log_weight)
+			for (int i=0; i<npart; ++i) {
+				max_log_weight = std::max(max_log_weight, particles.log_weight[i]);
 			}
 			
-			return -1;
+			if (std::isfinite(max_log_weight)) {
+				#pragma omp parallel for num_threads(num_threads)
+				for (int i=0; i<npart; ++i) {
+					particles.log_weight[i] -= max_log_weight;
+				}
+			}
 		}
 		
 		// Assigns a likelihood of 0 to every point further to an object than the minimum of the lidar range (in the moving direction)
 		void remove_particles_far_from_object() {
-			unsigned horizon_length = LIDAR_MIN*map.cellsPerMetre;
-			#pragma omp parallel for num_threads(5) 
-			for (auto& p : particles) {
-				unsigned x = (unsigned) p.coord.x;
-				unsigned y = (unsigned) p.coord.y;
-				if (!valid_position(x,y)) {
-					p.likelihood = 0.0f;
-				} else {
-					// If the particle can find a wall in the horizon, then likelihood is 1. It is 0 otherwise.
-					p.likelihood = calculate_simulation_distance(p, horizon_length) != -1 ? p.likelihood : 0.0;
+			unsigned horizon_length = LIDAR_MIN*map->cellsPerMetre;
+			const int npart = particles.size();
+			#pragma omp parallel for num_threads(num_threads) 
+			for (int i=0; i<npart; ++i) {
+				if (!valid_particle(i)) {
+					discard(i);
+				} else if (calculate_simulation_distance(i, horizon_length) == -1) {
+					// If the particle can find a wall in the horizon, then likelihood is kept. It is 0 otherwise.
+					discard(i);
 				}
 			}
 		}
 		
 		// Assigns a likelihood of 0 to every point closer to an object than the maximum of the lidar range (in the moving direction)
 		void remove_particles_close_to_object() {
-			unsigned horizon_length = LIDAR_MAX*map.cellsPerMetre;
-			#pragma omp parallel for num_threads(5) 
-			for (auto& p : particles) {
-				unsigned x = (unsigned) p.coord.x;
-				unsigned y = (unsigned) p.coord.y;
-				if (!valid_position(x,y)) {
-					p.likelihood = 0.0f;
-				} else {
-					// If the particle cannot find a wall in the horizon, then likelihood is 1. It is 0 otherwise.
-					p.likelihood = calculate_simulation_distance(p, horizon_length) == -1 ? p.likelihood : 0.0;
+			unsigned horizon_length = LIDAR_MAX*map->cellsPerMetre;
+			const int npart = particles.size();
+			#pragma omp parallel for num_threads(num_threads) 
+			for (int i=0; i<npart; ++i) {
+				if (!valid_particle(i)) {
+					discard(i);
+				} else if (calculate_simulation_distance(i, horizon_length) != -1) {
+					// If the particle cannot find a wall in the horizon, then likelihood is kept. It is 0 otherwise.
+					discard(i);
+				}
+			}
+		}
+		
+		// Keeps one out of beam_step of the beams with enough quality and a range the lidar can measure
+		void select_beams(const std::vector<Beam> &beams) {
+			beam_angles.clear();
+			beam_ranges.clear();
+			unsigned valid = 0;
+			for (const Beam &beam : beams) {
+				if (beam.quality < min_beam_quality || beam.range < LIDAR_MIN || beam.range >= LIDAR_MAX) {
+					continue;
+				}
+				if (valid++ % beam_step == 0) {
+					beam_angles.push_back(beam.angle);
+					beam_ranges.push_back(beam.range*map->cellsPerMetre);
 				}
 			}
 		}
 		
 	public:
 		
-		ParticleFilter(unsigned npart, const Map &user_map, 
+		ParticleFilter(unsigned npart, const MapHandle &user_map, 
 					   const float speed_f, const float speed_b, const float speed_r, const float cmd_duration,
 					   const float s_x1, const float s_y1, 
 					   const float s_x2, const float s_y2,
@@ -226,59 +366,187 @@ class ParticleFilter {
 					   const float s_lidar, const float lidar_min, const float lidar_max):
 					    
 					   particles(npart),
+					   deviation_a(npart),
+					   deviation_b(npart),
 					   map(user_map),
+					   ray_caster(&map.dda()),
+					   total_particles(npart),
+					   NOMINAL_PARTICLES(npart),
 					   SPEED_F(speed_f), SPEED_B(speed_b), SPEED_R(speed_r), COMMAND_DURATION(cmd_duration),
 					   S_X_F(s_x1), S_Y_F(s_y1), 
 					   S_X_B(s_x2), S_Y_B(s_y2), 
 					   S_ALPHA(s_alpha),
-					   S_LIDAR(s_lidar), LIDAR_MIN(lidar_min), LIDAR_MAX(lidar_max) {}
+					   S_LIDAR(s_lidar), LIDAR_MIN(lidar_min), LIDAR_MAX(lidar_max) {
+			
+			motion_rng.setSeed(rng.generateSeed());
+			resampler.setSeed(rng.generateSeed());
+			resampler.setNumThreads(num_threads);
+			spatial_sort.setNumThreads(num_threads);
+			reserve_buffers(npart);
+		}
+		
+		// Fixes the seed of the motion model and the resampler, making the filter reproducible
+		void setSeed(uint64_t seed) {
+			motion_rng.setSeed(seed);
+			motion_step = 0;
+			resampler.setSeed(~seed);
+		}
+		
+		void setResamplingMethod(ResamplingMethod method) {
+			resampler.setMethod(method);
+		}
+		
+		// Enables KLD-sampling: every resample() chooses the number of particles, between min_particles and max_particles,
+		// from the number of pose histogram bins covered by the belief.
+		// epsilon is the bound on the KL distance and z the upper 1-delta quantile of the standard normal distribution
+		void setKLDSampling(unsigned min_particles, unsigned max_particles, float epsilon = 0.05f, float z = 2.326f) {
+			kld_sampling = true;
+			kld.setBounds(min_particles, max_particles);
+			kld.setError(epsilon, z);
+			kld.setBinSize(0.1f*map->cellsPerMetre, 10.0f*M_PI/180.0f);
+			reserve_buffers(max_particles);
+		}
+		
+		// Size of the histogram bins used by KLD-sampling (metres and radians)
+		void setKLDBinSize(float xy, float alpha) {
+			kld.setBinSize(xy*map->cellsPerMetre, alpha);
+		}
+		
+		void disableKLDSampling() {
+			kld_sampling = false;
+		}
+		
+		// Upper bound on the number of particles, for example to fit a latency budget.
+		// It is applied by the next resampling, which resampleIfNeeded() forces if the set is larger than the budget
+		void setParticleBudget(unsigned max_particles) {
+			particle_budget = std::max(1u, max_particles);
+		}
+		
+		// Number of particles, counting the copies of a compressed set
+		unsigned getNumParticles() {
+			return total_particles;
+		}
+		
+		// Stores the copies made by the resampling as one particle with a count (see compress_duplicates)
+		void setDuplicateCompression(bool enable) {
+			compress_duplicates = enable;
+			if (!enable) {
+				expand_duplicates();
+			}
+		}
+		
+		// Selects how the expected lidar reading of each particle is computed.
+		// The lookup table and the CDDT use the given angular resolution (in radians). Like the distance field needed
+		// by sphere tracing and the pyramid, they are built on first use and shared by every filter on the same map
+		void setRayCastMethod(RayCastMethod method, float angular_resolution = M_PI/180.0f) {
+			ray_cast_method = method;
+			ray_cast_resolution = angular_resolution;
+			switch (method) {
+				case LOOKUP_TABLE:
+					ray_caster = &map.rangeTable(LIDAR_MAX*map->cellsPerMetre, angular_resolution);
+					break;
+				case COMPRESSED_DDT:
+					ray_caster = &map.cddt(angular_resolution);
+					break;
+				case SPHERE_TRACING:
+					ray_caster = &map.sphereTracing();
+					break;
+				case PYRAMID:
+					ray_caster = &map.pyramid();
+					break;
+				case RAY_MARCHING:
+					ray_caster = &map.rayMarching();
+					break;
+				default:
+					ray_caster = &map.dda();
+					break;
+			}
+		}
+		
+		// Storage layout of the occupancy grid of the map, used by the validity checks and the DDA ray casts
+		// (the AVX2 batched casts need the row major layout). The filter switches to a copy of the map in that layout,
+		// shared with the other filters that ask for it, and takes its ray caster and likelihood field from the copy
+		void setMapLayout(GridLayout layout) {
+			map = map.withLayout(layout);
+			setRayCastMethod(ray_cast_method, ray_cast_resolution);
+			if (likelihood_field) {
+				likelihood_field = &map.likelihoodField(S_LIDAR*map->cellsPerMetre);
+			}
+		}
+		
+		// Selects how a lidar reading in range is scored. The likelihood field is built on first use
+		void setSensorModel(SensorModel model) {
+			if (model == LIKELIHOOD_FIELD && !likelihood_field) {
+				likelihood_field = &map.likelihoodField(S_LIDAR*map->cellsPerMetre);
+			}
+			sensor_model = model;
+		}
+		
+		const MapHandle& getMap() {
+			return map;
+		}
+		
+		void setNumThreads(unsigned n) {
+			num_threads = n > 0 ? n : 1;
+			resampler.setNumThreads(num_threads);
+			spatial_sort.setNumThreads(num_threads);
+		}
 
 		void randomize() {
 		
-			int width = map.matrix.cols();
-			int height = map.matrix.rows();
+			multiplicity.clear();
+			particles.resize(total_particles);
 			
-			for(auto it=particles.begin(); it!=particles.end(); it++) {
-				*it = particle(rng.generateFloat(0, width),
-							   rng.generateFloat(0, height),
-							   rng.generateFloat(0, 2.0f*M_PI));
+			int width = map->width();
+			int height = map->height();
+			
+			for(unsigned i=0; i<particles.size(); ++i) {
+				particles.set(i, particle(rng.generateFloat(0, width),
+										  rng.generateFloat(0, height),
+										  rng.generateFloat(0, 2.0f*M_PI)));
 			}
 			
 		}
 		
-		void move(Action action) {
+		// Applies the action for steps consecutive commands at once: the duration is steps times COMMAND_DURATION and
+		// the deviations are sampled with the distribution of the sum of steps independent ones. The heading does not
+		// change while translating, so this is the same motion model as steps separate calls
+		void move(Action action, unsigned steps = 1) {
+			if (steps == 0) {
+				return;
+			}
+			
+			// The copies of a compressed set only differ after sampling their motion
+			if (action != DO_NOTHING) {
+				expand_duplicates();
+			}
+			
 			switch(action){
 				case GO_FORWARD:
-					for (auto& p : particles){
-						go_forward(p);
-					}
+					go_forward(steps);
 					break;
 				case GO_BACK:
-					for (auto& p : particles){
-						go_back(p);
-					}
+					go_back(steps);
 					break;
 				case TURN_LEFT:
-					for (auto& p : particles){
-						turn_left(p);
-					}
+					turn_left(steps);
 					break;
 				case TURN_RIGHT:
-					for (auto& p : particles){
-						turn_right(p);
-					}
+					turn_right(steps);
+					break;
+				default:
 					break;
 			}
 		}
 		
 		void updateLikelihood(float lidar_read = NULL) {
 			
+			const int npart = particles.size();
+			
 			if (!lidar_read) {
-				for (auto& p : particles) {
-					unsigned x = (unsigned) p.coord.x;
-					unsigned y = (unsigned) p.coord.y;
-					if (!valid_position(x,y)) {
-						p.likelihood = 0.0f;
+				for (int i=0; i<npart; ++i) {
+					if (!valid_particle(i)) {
+						discard(i);
 					}
 				}
 			} else {
@@ -292,68 +560,254 @@ class ParticleFilter {
 					remove_particles_close_to_object();
 					
 				} 
+				else if (sensor_model == LIKELIHOOD_FIELD) {
+					const float range = lidar_read*map->cellsPerMetre;
+					#pragma omp parallel for num_threads(num_threads) 
+					for (int i=0; i<npart; ++i) {
+						if (!valid_particle(i)) {
+							discard(i);
+						} else {
+							const float end_x = particles.x[i] + range*std::cos(particles.alpha[i]);
+							const float end_y = particles.y[i] + range*std::sin(particles.alpha[i]);
+							particles.log_weight[i] += likelihood_field->logLikelihood(end_x, end_y);
+						}
+					}
+				}
 				else {
-					unsigned horizon_length = LIDAR_MAX*map.cellsPerMetre;
-					#pragma omp parallel for num_threads(5) 
-					for (auto& p : particles) {
-						unsigned x = (unsigned) p.coord.x;
-						unsigned y = (unsigned) p.coord.y;
-						if (!valid_position(x,y)) {
-							p.likelihood = 0.0f;
+					// Rays cast in batches, so the backend can process several particles at once (see RayCaster::castBatch)
+					const unsigned horizon_length = LIDAR_MAX*map->cellsPerMetre;
+					simulated_ranges.resize(npart);
+					#pragma omp parallel num_threads(num_threads) 
+					{
+						unsigned begin, end;
+						thread_range(npart, begin, end);
+						ray_caster->castBatch(particles.x.data() + begin, particles.y.data() + begin, particles.alpha.data() + begin, 0.0f,
+											  end - begin, horizon_length, simulated_ranges.data() + begin);
+						for (unsigned i=begin; i<end; ++i) {
+							if (!valid_particle(i)) {
+								discard(i);
+							} else {
+								particles.log_weight[i] += rng.logProbabilityPointNormalDistribution(lidar_read*map->cellsPerMetre,
+																									simulated_ranges[i],
+																									S_LIDAR*map->cellsPerMetre);
+								//std::cout << "Normal Log-Likelihood:" << particles.log_weight[i] << std::endl;
+							}
+						}
+					}
+				}
+			}
+			
+			normalize_weights();
+		}
+		
+		// Scores every particle against all the selected beams of a scan (see setBeamSubsampling and setMinBeamQuality).
+		// The particles are processed in blocks of RAY_BATCH: every beam is cast for the whole block at once
+		// (see RayCaster::castBatch) while the map around the block is in cache
+		void updateLikelihood(const std::vector<Beam> &beams) {
+			select_beams(beams);
+			
+			const unsigned npart = particles.size();
+			const unsigned nbeams = beam_angles.size();
+			const unsigned horizon_length = LIDAR_MAX*map->cellsPerMetre;
+			const float sigma = S_LIDAR*map->cellsPerMetre;
+			
+			#pragma omp parallel num_threads(num_threads) 
+			{
+				unsigned begin, end;
+				thread_range(npart, begin, end);
+				
+				float ranges[RAY_BATCH];
+				float log_likelihood[RAY_BATCH];
+				for (unsigned block=begin; block<end; block+=RAY_BATCH) {
+					const unsigned n = end - block < RAY_BATCH ? end - block : RAY_BATCH;
+					const float *x = particles.x.data() + block;
+					const float *y = particles.y.data() + block;
+					const float *alpha = particles.alpha.data() + block;
+					
+					std::fill(log_likelihood, log_likelihood + n, 0.0f);
+					for (unsigned b=0; b<nbeams; ++b) {
+						if (sensor_model == LIKELIHOOD_FIELD) {
+							for (unsigned k=0; k<n; ++k) {
+								const float angle = alpha[k] + beam_angles[b];
+								const float end_x = x[k] + beam_ranges[b]*std::cos(angle);
+								const float end_y = y[k] + beam_ranges[b]*std::sin(angle);
+								log_likelihood[k] += likelihood_field->logLikelihood(end_x, end_y);
+							}
 						} else {
-							unsigned lidar_estimated_distance_ = lidar_read*map.cellsPerMetre;
-							int simulation_distance = calculate_simulation_distance(p, horizon_length);
-							
-							p.likelihood *= rng.probabilityPointNormalDistribution(lidar_read*map.cellsPerMetre,
-																				  simulation_distance,
-																				  S_LIDAR*map.cellsPerMetre);
-							//std::cout << "Normal Likelihood:" << p.likelihood << std::endl;
+							ray_caster->castBatch(x, y, alpha, beam_angles[b], n, horizon_length, ranges);
+							for (unsigned k=0; k<n; ++k) {
+								log_likelihood[k] += rng.logProbabilityPointNormalDistribution(beam_ranges[b], ranges[k], sigma);
+							}
+						}
+					}
+					
+					for (unsigned k=0; k<n; ++k) {
+						if (!valid_particle(block + k)) {
+							discard(block + k);
+						} else {
+							particles.log_weight[block + k] += log_likelihood[k];
 						}
 					}
 				}
 			}
 			
+			normalize_weights();
+		}
+		
+		// Uses one out of every 'step' valid beams of a scan
+		void setBeamSubsampling(unsigned step) {
+			beam_step = step > 0 ? step : 1;
+		}
+		
+		// Ignores the beams reported with a lower quality
+		void setMinBeamQuality(unsigned quality) {
+			min_beam_quality = quality;
+		}
+		
+		// Effective sample size of the current weights, (sum w)^2/sum w^2, in [1, N]. It is N when all particles weigh the same
+		float effectiveSampleSize() {
+			const int npart = particles.size();
+			double sum = 0.0;
+			double sum_sq = 0.0;
+			#pragma omp parallel for num_threads(num_threads) reduction(+:sum,sum_sq)
+			for (int i=0; i<npart; ++i) {
+				// Weights are normalized by the maximum after every update, so exp() cannot overflow
+				const double w = std::exp((double)particles.log_weight[i]);
+				const double copies = multiplicity.empty() ? 1.0 : multiplicity[i];
+				sum += copies*w;
+				sum_sq += copies*w*w;
+			}
+			
+			return sum_sq > 0.0 ? sum*sum/sum_sq : 0.0f;
+		}
+		
+		// resampleIfNeeded() only resamples when the effective sample size drops below ratio*N.
+		// With a ratio of 1 or more it resamples after every update
+		void setResampleThreshold(float ratio) {
+			resample_threshold = ratio;
+		}
+		
+		// Every every_k resamples, the new particles are stored in the order of their cells along a Hilbert curve,
+		// so the ray casts of consecutive particles hit the same parts of the map. 0 disables it.
+		// The order survives the resamples in between: the parents are drawn in increasing order of index
+		void setSpatialReorder(unsigned every_k) {
+			spatial_reorder_period = every_k;
+			resamples_since_reorder = 0;
+		}
+		
+		bool resampleIfNeeded() {
+			if (total_particles > particle_budget || effectiveSampleSize() < resample_threshold*total_particles) {
+				resample();
+				return true;
+			}
+			return false;
 		}
 		
 		// Resample phase of the particle filter
 		void resample() {
-			int npart = particles.size();
+			const unsigned npart = particles.size();
+			unsigned new_npart = std::min(kld_sampling ? kld.maxParticles() : NOMINAL_PARTICLES, particle_budget);
 			
 			// We use the likelihood of each particle (or an increasing non linear function of it) as weight for the resampling
-			std::vector<float> weights;
-			weights.reserve(npart);
-			for(auto& p : particles) {
-				weights.push_back(p.likelihood*p.likelihood);
+			weights.resize(npart);
+			#pragma omp parallel for num_threads(num_threads)
+			for(int i=0; i<(int)npart; ++i) {
+				weights[i] = std::exp(2.0f*particles.log_weight[i]);
+				if (!multiplicity.empty()) {
+					weights[i] *= multiplicity[i];
+				}
 			}
 			
-			std::vector<unsigned> new_particle_indices = rng.generateNFromDiscreteDistribution(npart, weights);
-			std::vector<particle> new_particles;
-			float max_likelihood = 0.0f;
-			for(int i=0; i<npart; ++i) {
-				int j = new_particle_indices[i];
-				particle new_particle = particles[j];
-				new_particles.push_back(new_particle);
-				
-				if(new_particle.likelihood > max_likelihood) {
-					max_likelihood = new_particle.likelihood;
+			new_particle_indices.resize(new_npart);
+			bool resampled = resampler.resample(weights.data(), npart, new_npart, new_particle_indices.data());
+			if (resampled && kld_sampling) {
+				// KLD-sampling counts the bins of the samples actually drawn: draw the most particles allowed, then
+				// draw again as many as the bins they cover require (a systematic draw has no representative prefix)
+				const unsigned required = std::min(kld.particleCount(particles, new_particle_indices.data(), new_npart,
+																	 map->width(), map->height()), new_npart);
+				if (required < new_npart) {
+					new_npart = required;
+					new_particle_indices.resize(new_npart);
+					resampled = resampler.resample(weights.data(), npart, new_npart, new_particle_indices.data());
 				}
 			}
-			
-			// Normalize particle weight
-		    if (max_likelihood > 0.0f) {
-				for(auto it=new_particles.begin(); it!=new_particles.end(); ++it) {
-					it->likelihood /= max_likelihood;
+			if (resampled) {
+				// The copies are in the cell of their parent, so sorting the parent indices is enough
+				if (spatial_reorder_period > 0 && ++resamples_since_reorder >= spatial_reorder_period) {
+					spatial_sort.sort(particles, new_particle_indices.data(), new_npart, map->width(), map->height());
+					resamples_since_reorder = 0;
 				}
-		    }
-		    
-/*		    std::cout << "Max weight: "<<max_likelihood << std::endl;*/
+				total_particles = new_npart;
+				if (compress_duplicates) {
+					// The copies of a particle are next to each other (also after the spatial sort, which is stable)
+					unsigned nunique = 0;
+					multiplicity.clear();
+					for (unsigned i=0; i<new_npart; ++i) {
+						if (i > 0 && new_particle_indices[i] == new_particle_indices[i-1]) {
+							++multiplicity.back();
+						} else {
+							new_particle_indices[nunique++] = new_particle_indices[i];
+							multiplicity.push_back(1);
+						}
+					}
+					gather(new_particle_indices.data(), nunique);
+				} else {
+					multiplicity.clear();
+					gather(new_particle_indices.data(), new_npart);
+				}
+			}
+			// If every particle had been discarded the set is kept as it is, instead of collapsing it
 			
-			particles = new_particles;
+			// The new set represents the posterior with uniform weights
+			std::fill(particles.log_weight.begin(), particles.log_weight.end(), 0.0f);
 		}
 		
+		// Weighted mean pose of the particles: position in cells, heading averaged on the unit circle.
+		// Its likelihood is the total weight, relative to the best particle
+		particle estimatePose() {
+			const int npart = particles.size();
+			double sum_w = 0.0, sum_x = 0.0, sum_y = 0.0, sum_cos = 0.0, sum_sin = 0.0;
+			#pragma omp parallel for num_threads(num_threads) reduction(+:sum_w,sum_x,sum_y,sum_cos,sum_sin)
+			for (int i=0; i<npart; ++i) {
+				const double w = std::exp((double)particles.log_weight[i])*(multiplicity.empty() ? 1 : multiplicity[i]);
+				sum_w += w;
+				sum_x += w*particles.x[i];
+				sum_y += w*particles.y[i];
+				sum_cos += w*std::cos(particles.alpha[i]);
+				sum_sin += w*std::sin(particles.alpha[i]);
+			}
+			
+			if (sum_w <= 0.0) {
+				particle none;
+				none.likelihood = 0.0f;
+				return none;
+			}
+			const double heading = std::atan2(sum_sin, sum_cos);
+			particle pose(sum_x/sum_w, sum_y/sum_w, heading >= 0.0 ? heading : heading + 2.0*M_PI);
+			pose.likelihood = sum_w;
+			return pose;
+		}
+		
+		// Copy of the particles with the copies of a compressed set expanded. It allocates a new vector on every call:
+		// code that runs every cycle should read getParticleSet() and getMultiplicities() instead
 		std::vector<particle> getParticles() {
+			std::vector<particle> particle_list;
+			particle_list.reserve(total_particles);
+			for(unsigned i=0; i<particles.size(); ++i) {
+				particle_list.insert(particle_list.end(), multiplicity.empty() ? 1 : multiplicity[i], particles.get(i));
+			}
+			return particle_list;
+		}
+		
+		// Stored particles. With duplicate compression, particle i stands for getMultiplicities()[i] copies
+		const ParticleSet& getParticleSet() {
 			return particles;
 		}
+		
+		// Copies of each stored particle, empty when every particle is stored once
+		const std::vector<unsigned>& getMultiplicities() {
+			return multiplicity;
+		}
 			
 };
 
@@ -0,0 +1,82 @@
+#ifndef PARTICLE_SET_H
+#define PARTICLE_SET_H
+
+#include <vector>
+#include <cmath>
+#include "coord2D.h"
+#include "AlignedAllocator.h"
+
+struct particle {
+	floatCoord2D coord;
+	float alpha;
+	float likelihood = 1.0;
+
+	particle(): coord(0.0f,0.0f) {
+		alpha = 0.0f;
+	}
+
+	particle(float x, float y, float angle): coord(x,y) {
+		alpha = angle;
+	}
+};
+
+// Particles stored as a structure of arrays (one aligned array per state variable).
+// The motion and sensor models only touch the variables they need, and 8 consecutive particles fill one AVX register.
+struct ParticleSet {
+	aligned_vector<float> x;
+	aligned_vector<float> y;
+	aligned_vector<float> alpha;
+	aligned_vector<float> log_weight; // log-likelihood accumulated since the last resampling (-inf for discarded particles)
+
+	ParticleSet(unsigned npart = 0) {
+		resize(npart);
+	}
+
+	void resize(unsigned npart) {
+		x.resize(npart, 0.0f);
+		y.resize(npart, 0.0f);
+		alpha.resize(npart, 0.0f);
+		log_weight.resize(npart, 0.0f);
+	}
+
+	// Capacity for npart particles, so resizing up to npart does not allocate
+	void reserve(unsigned npart) {
+		x.reserve(npart);
+		y.reserve(npart);
+		alpha.reserve(npart);
+		log_weight.reserve(npart);
+	}
+
+	unsigned size() const {
+		return x.size();
+	}
+
+	particle get(unsigned i) const {
+		particle p(x[i], y[i], alpha[i]);
+		p.likelihood = std::exp(log_weight[i]);
+		return p;
+	}
+
+	void set(unsigned i, const particle &p) {
+		x[i] = p.coord.x;
+		y[i] = p.coord.y;
+		alpha[i] = p.alpha;
+		log_weight[i] = std::log(p.likelihood);
+	}
+
+	void copy(unsigned dst, const ParticleSet &src, unsigned i) {
+		x[dst] = src.x[i];
+		y[dst] = src.y[i];
+		alpha[dst] = src.alpha[i];
+		log_weight[dst] = src.log_weight[i];
+	}
+
+	void swap(ParticleSet &other) {
+		x.swap(other.x);
+		y.swap(other.y);
+		alpha.swap(other.alpha);
+		log_weight.swap(other.log_weight);
+	}
+};
+
+#endif
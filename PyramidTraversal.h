@@ -0,0 +1,77 @@
+// Ray casting with hierarchical empty space skipping over an OccupancyPyramid.
+// At each step the ray crosses the largest empty block of the pyramid that contains its current cell,
+// going up one level after every block and down only where a block contains a wall.
+// Long rays through open space then cost a few steps per block size instead of one per cell.
+
+#ifndef PYRAMID_TRAVERSAL_H
+#define PYRAMID_TRAVERSAL_H
+
+#include <cmath>
+#include <algorithm>
+#include "Map.h"
+#include "RayCaster.h"
+#include "OccupancyPyramid.h"
+
+class PyramidTraversal : public RayCaster {
+
+	private:
+		const OccupancyPyramid pyramid;
+		const unsigned TOP_LEVEL;
+		
+		// Nudge past a block border so the next position falls in the next block
+		const float BORDER_EPSILON = 1e-4f;
+		
+	public:
+		// max_levels bounds the size of the skipped blocks to 2^(max_levels-1) cells
+		PyramidTraversal(const Map &map, unsigned max_levels = 8):
+						 pyramid(map, max_levels),
+						 TOP_LEVEL(pyramid.numLevels() - 1) {}
+		
+		float range(float x, float y, float alpha, unsigned horizon_length) const {
+			const float dx = std::cos(alpha);
+			const float dy = std::sin(alpha);
+			const float inv_dx = 1.0f/dx;
+			const float inv_dy = 1.0f/dy;
+			
+			const unsigned cols = pyramid.width();
+			const unsigned rows = pyramid.height();
+			
+			unsigned level = TOP_LEVEL;
+			float t = 0.0f;
+			while (t < horizon_length) {
+				const float px = x + t*dx;
+				const float py = y + t*dy;
+				// Truncation only differs from floor for negative coordinates, which are outside the map anyway
+				const int cell_x = (int)px;
+				const int cell_y = (int)py;
+				if (px < 0.0f || py < 0.0f || (unsigned)cell_x >= cols || (unsigned)cell_y >= rows) {
+					return t;
+				}
+				
+				while (level > 0 && pyramid.occupied(level, cell_x, cell_y)) {
+					--level;
+				}
+				if (level == 0 && pyramid.occupied(0, cell_x, cell_y)) {
+					return t;
+				}
+				
+				// Leave the empty block through its closest border
+				const int block_x = (cell_x >> level) << level;
+				const int block_y = (cell_y >> level) << level;
+				const int size = 1 << level;
+				const float next_x = dx == 0.0f ? INFINITY : (dx > 0.0f ? block_x + size - px : block_x - px)*inv_dx;
+				const float next_y = dy == 0.0f ? INFINITY : (dy > 0.0f ? block_y + size - py : block_y - py)*inv_dy;
+				t += std::min(next_x, next_y) + BORDER_EPSILON;
+				
+				level = std::min(level + 1, TOP_LEVEL);
+			}
+			
+			return -1;
+		}
+		
+		size_t memoryUsage() const {
+			return pyramid.memoryUsage();
+		}
+};
+
+#endif
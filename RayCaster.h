@@ -0,0 +1,63 @@
+// Ray casting backends used by the sensor model to simulate the lidar reading of a particle
+
+#ifndef RAY_CASTER_H
+#define RAY_CASTER_H
+
+#include <cmath>
+#include "Map.h"
+
+enum RayCastMethod {
+	RAY_MARCHING,  // steps along the ray on the map, 2 cells at a time
+	DDA,           // exact traversal of every cell crossed by the ray
+	LOOKUP_TABLE,  // precomputed range for every free cell and quantized heading
+	COMPRESSED_DDT, // binary search in the sorted wall projections of each heading (CDDT)
+	SPHERE_TRACING, // jumps along the ray by the distance to the closest wall
+	PYRAMID         // skips the empty blocks of a max-pooled occupancy pyramid
+};
+
+class RayCaster {
+
+	public:
+		virtual ~RayCaster() {}
+		
+		// Distance (in cells) from (x,y) to the closest wall in direction alpha, or -1 if there is none closer than horizon_length
+		virtual float range(float x, float y, float alpha, unsigned horizon_length) const = 0;
+		
+		// Ranges of n rays, from (x[i],y[i]) in direction alpha[i]+angle_offset, written to ranges[i].
+		// Backends that can cast several rays at once override it
+		virtual void castBatch(const float *x, const float *y, const float *alpha, float angle_offset,
+							   unsigned n, unsigned horizon_length, float *ranges) const {
+			for (unsigned i=0; i<n; ++i) {
+				ranges[i] = range(x[i], y[i], alpha[i] + angle_offset, horizon_length);
+			}
+		}
+};
+
+// Marches along the ray in steps of 2 cells
+class RayMarching : public RayCaster {
+
+	private:
+		const Map &map;
+		
+	public:
+		RayMarching(const Map &user_map): map(user_map) {}
+		
+		float range(float px, float py, float alpha, unsigned horizon_length) const {
+			unsigned x = (unsigned) px;
+			unsigned y = (unsigned) py;
+			const float dx = cos(alpha);
+			const float dy = sin(alpha); 
+			for (int i=2; (i*i*dx*dx+i*i*dy*dy)<(horizon_length*horizon_length); i+=2) {
+				unsigned x_i = (unsigned)(x+i*dx);
+				unsigned y_i = (unsigned)(y+i*dy);
+				if(!map.isFree(x_i, y_i)) {
+					//std::cout << "Distance in map:" << (int)sqrt(i*i*dx*dx+i*i*dy*dy) << std::endl;
+					return (int)sqrt(i*i*dx*dx+i*i*dy*dy);
+				} 
+			}
+			
+			return -1;
+		}
+};
+
+#endif
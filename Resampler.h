@@ -0,0 +1,280 @@
+// Low variance resampling schemes. All of them run in O(N) over the cumulative sum of the weights
+// and return the parent indices in increasing order.
+// Systematic and stratified resampling also have a multi-threaded version: a parallel prefix sum over the weights,
+// after which every thread draws the offsets that fall in its own slice of the cumulative sum and writes
+// them into its own (disjoint) range of the output.
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include <omp.h>
+#include "CounterRNG.h"
+
+enum ResamplingMethod {
+	SYSTEMATIC,  // one uniform draw, offsets evenly spaced
+	STRATIFIED,  // one uniform draw per stratum
+	RESIDUAL     // deterministic copies of floor(m*w), systematic resampling of the remainders
+};
+
+class Resampler {
+
+	private:
+		ResamplingMethod method = SYSTEMATIC;
+
+		// Uniform draws: one stream per resample call
+		CounterRNG rng;
+		uint64_t draw = 0;
+
+		// Below this number of particles the threads cost more than they save
+		static const unsigned PARALLEL_THRESHOLD = 1 << 16;
+		unsigned num_threads = 1;
+
+		// Preallocated buffers
+		std::vector<double> cumulative;
+		std::vector<double> residuals;
+		std::vector<unsigned> counts;
+		std::vector<double> partial_sums;
+		std::vector<unsigned> chunk_bounds;
+
+		// Computes the inclusive prefix sum of the weights and returns the total
+		double cumulative_sum(const float *weights, unsigned n) {
+			cumulative.resize(n);
+			double sum = 0.0;
+			for (unsigned i=0; i<n; ++i) {
+				sum += weights[i];
+				cumulative[i] = sum;
+			}
+			return sum;
+		}
+
+		// Walks the cumulative sum of particles [i_begin, i_end) once, assigning to the outputs j in [j_begin, j_end)
+		// the first particle whose cumulative weight reaches offset(j)
+		template <class Offset>
+		void select(unsigned i_begin, unsigned i_end, unsigned j_begin, unsigned j_end, Offset offset, unsigned *indices) {
+			unsigned i = i_begin;
+			for (unsigned j=j_begin; j<j_end; ++j) {
+				const double target = offset(j);
+				while (i < i_end-1 && cumulative[i] < target) {
+					++i;
+				}
+				indices[j] = i;
+			}
+		}
+
+		// Offsets of systematic resampling: (u + j)*step, with a single uniform u
+		struct SystematicOffset {
+			double u, step;
+			double operator()(unsigned j) const { return u + j*step; }
+			// Number of offsets lower or equal than the cumulative weight c
+			unsigned count(double c, unsigned m) const {
+				return c < u ? 0 : std::min<double>(m, std::floor((c - u)/step) + 1);
+			}
+		};
+
+		// Offsets of stratified resampling: (j + u_j)*step, with one uniform u_j per stratum
+		struct StratifiedOffset {
+			const CounterRNG *rng;
+			uint64_t stream;
+			double step;
+			double operator()(unsigned j) const { return (j + rng->uniform(stream, j))*step; }
+			unsigned count(double c, unsigned m) const {
+				const double j = std::floor(c/step);
+				if (j >= m) {
+					return m;
+				}
+				return j + ((*this)(j) <= c ? 1 : 0);
+			}
+		};
+
+		SystematicOffset systematic_offset(unsigned m, double total, uint64_t stream) {
+			SystematicOffset offset;
+			offset.step = total/m;
+			offset.u = rng.uniform(stream, 0)*offset.step;
+			return offset;
+		}
+
+		StratifiedOffset stratified_offset(unsigned m, double total, uint64_t stream) {
+			StratifiedOffset offset;
+			offset.rng = &rng;
+			offset.stream = stream;
+			offset.step = total/m;
+			return offset;
+		}
+
+		// Parallel version of cumulative_sum. The chunk of weights scanned by each thread is kept in chunk_bounds
+		double parallel_cumulative_sum(const float *weights, unsigned n) {
+			cumulative.resize(n);
+			partial_sums.assign(num_threads + 1, 0.0);
+			chunk_bounds.assign(num_threads + 1, n);
+			unsigned nchunks = 1;
+
+			#pragma omp parallel num_threads(num_threads)
+			{
+				const unsigned nthreads = omp_get_num_threads();
+				const unsigned t = omp_get_thread_num();
+				const unsigned chunk = (n + nthreads - 1)/nthreads;
+				const unsigned i_begin = std::min(t*chunk, n);
+				const unsigned i_end = std::min(i_begin + chunk, n);
+				chunk_bounds[t] = i_begin;
+
+				// Local prefix sums, then offset them by the sum of the previous chunks
+				double sum = 0.0;
+				for (unsigned i=i_begin; i<i_end; ++i) {
+					sum += weights[i];
+					cumulative[i] = sum;
+				}
+				partial_sums[t+1] = sum;
+
+				#pragma omp barrier
+				#pragma omp single
+				{
+					nchunks = nthreads;
+					for (unsigned k=0; k<nthreads; ++k) {
+						partial_sums[k+1] += partial_sums[k];
+					}
+				}
+
+				const double chunk_start = partial_sums[t];
+				for (unsigned i=i_begin; i<i_end; ++i) {
+					cumulative[i] += chunk_start;
+				}
+			}
+
+			chunk_bounds.resize(nchunks + 1);
+			return partial_sums[nchunks];
+		}
+
+		// Parallel version of select. The outputs whose offset falls in the slice (partial_sums[k], partial_sums[k+1]]
+		// of the cumulative sum belong to chunk k, so every chunk knows where to write without synchronization
+		template <class Offset>
+		void parallel_select(unsigned m, const Offset &offset, unsigned *indices) {
+			const int nchunks = chunk_bounds.size() - 1;
+
+			#pragma omp parallel for num_threads(num_threads)
+			for (int k=0; k<nchunks; ++k) {
+				const unsigned i_begin = chunk_bounds[k];
+				const unsigned i_end = chunk_bounds[k+1];
+				if (i_begin < i_end) {
+					const unsigned j_begin = k == 0 ? 0 : offset.count(partial_sums[k], m);
+					const unsigned j_end = k == nchunks-1 ? m : offset.count(partial_sums[k+1], m);
+					select(i_begin, i_end, j_begin, j_end, offset, indices);
+				}
+			}
+		}
+
+		void systematic(unsigned n, unsigned m, double total, unsigned *indices, uint64_t stream) {
+			select(0, n, 0, m, systematic_offset(m, total, stream), indices);
+		}
+
+		void stratified(unsigned n, unsigned m, double total, unsigned *indices, uint64_t stream) {
+			select(0, n, 0, m, stratified_offset(m, total, stream), indices);
+		}
+
+		void residual(const float *weights, unsigned n, unsigned m, double total, unsigned *indices, uint64_t stream) {
+			counts.resize(n);
+			residuals.resize(n);
+
+			// Deterministic part
+			unsigned assigned = 0;
+			double residual_total = 0.0;
+			for (unsigned i=0; i<n; ++i) {
+				const double expected = m*(weights[i]/total);
+				counts[i] = (unsigned)expected;
+				assigned += counts[i];
+				residual_total += expected - counts[i];
+				residuals[i] = residual_total;
+			}
+
+			// Systematic resampling of the remaining m-assigned particles over the residual weights
+			const unsigned remaining = m - assigned;
+			if (remaining > 0 && residual_total > 0.0) {
+				const double step = residual_total/remaining;
+				double target = rng.uniform(stream, 0)*step;
+				unsigned i = 0;
+				for (unsigned j=0; j<remaining; ++j, target+=step) {
+					while (i < n-1 && residuals[i] < target) {
+						++i;
+					}
+					++counts[i];
+				}
+			}
+
+			unsigned j = 0;
+			for (unsigned i=0; i<n; ++i) {
+				for (unsigned c=0; c<counts[i] && j<m; ++c) {
+					indices[j++] = i;
+				}
+			}
+		}
+
+	public:
+
+		Resampler(uint64_t seed = 0): rng(seed) {}
+
+		void setSeed(uint64_t seed) {
+			rng.setSeed(seed);
+			draw = 0;
+		}
+
+		// Capacity for n particles, so the buffers do not grow during the resamplings
+		void reserve(unsigned n) {
+			cumulative.reserve(n);
+			residuals.reserve(n);
+			counts.reserve(n);
+		}
+
+		void setNumThreads(unsigned n) {
+			num_threads = n > 0 ? n : 1;
+		}
+
+		void setMethod(ResamplingMethod resampling_method) {
+			method = resampling_method;
+		}
+
+		ResamplingMethod getMethod() {
+			return method;
+		}
+
+		// Draws m indices in [0,n) with probability proportional to weights.
+		// Returns false (and leaves indices untouched) if every weight is 0.
+		bool resample(const float *weights, unsigned n, unsigned m, unsigned *indices) {
+			if (n == 0 || m == 0) {
+				return false;
+			}
+
+			const bool parallel = num_threads > 1 && n >= PARALLEL_THRESHOLD && method != RESIDUAL;
+			
+			const double total = parallel ? parallel_cumulative_sum(weights, n) : cumulative_sum(weights, n);
+			if (!(total > 0.0)) {
+				return false;
+			}
+
+			const uint64_t stream = draw++;
+			switch (method) {
+				case SYSTEMATIC:
+					if (parallel) {
+						parallel_select(m, systematic_offset(m, total, stream), indices);
+					} else {
+						systematic(n, m, total, indices, stream);
+					}
+					break;
+				case STRATIFIED:
+					if (parallel) {
+						parallel_select(m, stratified_offset(m, total, stream), indices);
+					} else {
+						stratified(n, m, total, indices, stream);
+					}
+					break;
+				case RESIDUAL:
+					residual(weights, n, m, total, indices, stream);
+					break;
+			}
+			return true;
+		}
+};
+
+#endif
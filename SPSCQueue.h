@@ -0,0 +1,66 @@
+// Bounded lock-free queue between one producer thread and one consumer thread.
+// The elements live in a ring of a power of two slots. Only the producer writes the tail and only the consumer
+// writes the head; each publishes its index with release semantics once the slot is written (or read), so the other
+// side sees the element complete. Neither side ever waits for the other or allocates.
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+template <class T>
+class SPSCQueue {
+
+	private:
+		static const size_t CACHE_LINE = 64;
+
+		std::vector<T> slots;
+		const size_t mask;
+
+		// On different cache lines, so the two threads do not invalidate each other's index
+		alignas(CACHE_LINE) std::atomic<size_t> head; // next slot to read, written by the consumer
+		alignas(CACHE_LINE) std::atomic<size_t> tail; // next slot to write, written by the producer
+
+		static size_t round_up_pow2(size_t n) {
+			size_t p = 1;
+			while (p < n) {
+				p *= 2;
+			}
+			return p;
+		}
+
+	public:
+		// Holds at least 'capacity' elements
+		SPSCQueue(size_t capacity): slots(round_up_pow2(capacity)), mask(slots.size() - 1), head(0), tail(0) {}
+
+		// Producer only. Returns false if the queue is full
+		bool push(const T &element) {
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == slots.size()) {
+				return false;
+			}
+			slots[t & mask] = element;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer only. Returns false if the queue is empty
+		bool pop(T &element) {
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (tail.load(std::memory_order_acquire) == h) {
+				return false;
+			}
+			element = slots[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Approximate when called while the other thread is running
+		size_t size() const {
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+};
+
+#endif
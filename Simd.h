@@ -0,0 +1,109 @@
+// AVX2 helpers. The kernels are compiled with a target attribute instead of a global -mavx2 flag,
+// so the same binary runs on machines without AVX2 (callers check cpuHasAVX2() and fall back to scalar code).
+// sincos_ps and log_ps are adapted from the Cephes single precision functions (as in avx_mathfun.h by G. Garberoglio).
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <immintrin.h>
+
+#define SIMD_AVX2 __attribute__((target("avx2,fma")))
+
+inline bool cpuHasAVX2() {
+	static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return has_avx2;
+}
+
+namespace simd {
+
+	// Sine and cosine of 8 floats at once. Accurate to ~1 ulp for |x| < 8192
+	SIMD_AVX2 inline void sincos_ps(__m256 x, __m256 *s, __m256 *c) {
+		const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+
+		__m256 sign_bit_sin = _mm256_and_ps(x, sign_mask);
+		x = _mm256_andnot_ps(sign_mask, x);
+
+		// Scale by 4/Pi and round to the closest even octant
+		__m256 y = _mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f));
+		__m256i j = _mm256_cvttps_epi32(y);
+		j = _mm256_add_epi32(j, _mm256_set1_epi32(1));
+		j = _mm256_and_si256(j, _mm256_set1_epi32(~1));
+		y = _mm256_cvtepi32_ps(j);
+
+		const __m256 swap_sign_bit_sin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+		const __m256 poly_mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+		const __m256 sign_bit_cos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+		sign_bit_sin = _mm256_xor_ps(sign_bit_sin, swap_sign_bit_sin);
+
+		// Extended precision modular arithmetic: x = ((x - y*DP1) - y*DP2) - y*DP3
+		x = _mm256_fmadd_ps(y, _mm256_set1_ps(-0.78515625f), x);
+		x = _mm256_fmadd_ps(y, _mm256_set1_ps(-2.4187564849853515625e-4f), x);
+		x = _mm256_fmadd_ps(y, _mm256_set1_ps(-3.77489497744594108e-8f), x);
+
+		const __m256 z = _mm256_mul_ps(x, x);
+
+		// Cosine polynomial in [0, Pi/4]
+		__m256 yc = _mm256_set1_ps(2.443315711809948E-005f);
+		yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(-1.388731625493765E-003f));
+		yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(4.166664568298827E-002f));
+		yc = _mm256_mul_ps(_mm256_mul_ps(yc, z), z);
+		yc = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), yc);
+		yc = _mm256_add_ps(yc, _mm256_set1_ps(1.0f));
+
+		// Sine polynomial in [0, Pi/4]
+		__m256 ys = _mm256_set1_ps(-1.9515295891E-4f);
+		ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(8.3321608736E-3f));
+		ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(-1.6666654611E-1f));
+		ys = _mm256_mul_ps(_mm256_mul_ps(ys, z), x);
+		ys = _mm256_add_ps(ys, x);
+
+		// Pick the right polynomial for each octant
+		const __m256 sin_val = _mm256_blendv_ps(yc, ys, poly_mask);
+		const __m256 cos_val = _mm256_blendv_ps(ys, yc, poly_mask);
+
+		*s = _mm256_xor_ps(sin_val, sign_bit_sin);
+		*c = _mm256_xor_ps(cos_val, sign_bit_cos);
+	}
+
+	// Natural logarithm of 8 positive floats at once
+	SIMD_AVX2 inline __m256 log_ps(__m256 x) {
+		const __m256 one = _mm256_set1_ps(1.0f);
+
+		x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000))); // cut off denormals
+
+		// Split x into exponent e and mantissa in [0.5, 1)
+		__m256i imm0 = _mm256_srli_epi32(_mm256_castps_si256(x), 23);
+		x = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000)));
+		x = _mm256_or_ps(x, _mm256_set1_ps(0.5f));
+		imm0 = _mm256_sub_epi32(imm0, _mm256_set1_epi32(0x7f));
+		__m256 e = _mm256_add_ps(_mm256_cvtepi32_ps(imm0), one);
+
+		// Move the mantissa to [sqrt(1/2), sqrt(2)) and subtract 1
+		const __m256 mask = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OS);
+		const __m256 tmp = _mm256_and_ps(x, mask);
+		x = _mm256_sub_ps(x, one);
+		e = _mm256_sub_ps(e, _mm256_and_ps(one, mask));
+		x = _mm256_add_ps(x, tmp);
+
+		const __m256 z = _mm256_mul_ps(x, x);
+
+		__m256 y = _mm256_set1_ps(7.0376836292E-2f);
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.1514610310E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.1676998740E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.2420140846E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.4249322787E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-1.6668057665E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(2.0000714765E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(-2.4999993993E-1f));
+		y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(3.3333331174E-1f));
+		y = _mm256_mul_ps(_mm256_mul_ps(y, x), z);
+
+		y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+		y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+		x = _mm256_add_ps(x, y);
+		return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), x);
+	}
+
+}
+
+#endif
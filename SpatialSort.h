@@ -0,0 +1,131 @@
+// Ordering of the particles along a Hilbert curve over the map cells.
+// Consecutive particles then lie in neighbouring cells, so the ray casts of consecutive particles read the same
+// cache lines of the map (and of the tables of the ray casting backends) instead of jumping across it.
+// The Hilbert indices are sorted with a least significant digit radix sort (stable, 8 bits per pass) which
+// runs in parallel: every thread counts the digits of its own chunk, and a prefix sum over (digit, thread)
+// gives each thread the positions where it scatters its chunk.
+
+#ifndef SPATIAL_SORT_H
+#define SPATIAL_SORT_H
+
+#include <vector>
+#include <stdint.h>
+#include <algorithm>
+#include <omp.h>
+#include "ParticleSet.h"
+
+class SpatialSort {
+
+	private:
+		static const unsigned RADIX_BITS = 8;
+		static const unsigned RADIX = 1 << RADIX_BITS;
+
+		// Below this number of particles the threads cost more than they save
+		static const unsigned PARALLEL_THRESHOLD = 1 << 15;
+		unsigned num_threads = 1;
+
+		// Preallocated buffers
+		std::vector<uint32_t> keys;
+		std::vector<uint32_t> sorted_keys;
+		std::vector<unsigned> order;
+		std::vector<unsigned> sorted_order;
+		std::vector<unsigned> histograms; // RADIX counters per thread
+
+		// One pass of the radix sort over the digit at the given shift, from (keys, order) to (sorted_keys, sorted_order)
+		void radix_pass(unsigned n, unsigned shift, unsigned nthreads_max) {
+			histograms.assign((size_t)nthreads_max*RADIX, 0);
+
+			#pragma omp parallel num_threads(nthreads_max)
+			{
+				const unsigned nthreads = omp_get_num_threads();
+				const unsigned t = omp_get_thread_num();
+				const unsigned chunk = (n + nthreads - 1)/nthreads;
+				const unsigned i_begin = std::min(t*chunk, n);
+				const unsigned i_end = std::min(i_begin + chunk, n);
+				unsigned *count = histograms.data() + (size_t)t*RADIX;
+
+				for (unsigned i=i_begin; i<i_end; ++i) {
+					++count[(keys[i] >> shift) & (RADIX - 1)];
+				}
+
+				#pragma omp barrier
+				#pragma omp single
+				{
+					// Exclusive prefix sum, digit by digit and thread by thread within each digit, so the sort is stable
+					unsigned sum = 0;
+					for (unsigned d=0; d<RADIX; ++d) {
+						for (unsigned k=0; k<nthreads; ++k) {
+							const unsigned c = histograms[(size_t)k*RADIX + d];
+							histograms[(size_t)k*RADIX + d] = sum;
+							sum += c;
+						}
+					}
+				}
+
+				for (unsigned i=i_begin; i<i_end; ++i) {
+					const unsigned position = count[(keys[i] >> shift) & (RADIX - 1)]++;
+					sorted_keys[position] = keys[i];
+					sorted_order[position] = order[i];
+				}
+			}
+
+			keys.swap(sorted_keys);
+			order.swap(sorted_order);
+		}
+
+	public:
+		void setNumThreads(unsigned n) {
+			num_threads = n > 0 ? n : 1;
+		}
+
+		// Position of cell (x,y) along the Hilbert curve that covers a square of 2^order_bits cells per side
+		static uint32_t hilbertIndex(unsigned order_bits, uint32_t x, uint32_t y) {
+			uint32_t index = 0;
+			for (uint32_t s = (1u << order_bits) >> 1; s > 0; s >>= 1) {
+				const uint32_t rx = (x & s) ? 1 : 0;
+				const uint32_t ry = (y & s) ? 1 : 0;
+				index += s*s*((3*rx) ^ ry);
+				// Rotates the quadrant, so the curve inside it starts and ends next to the neighbouring quadrants
+				if (ry == 0) {
+					if (rx == 1) {
+						x = s - 1 - (x & (s - 1));
+						y = s - 1 - (y & (s - 1));
+					}
+					std::swap(x, y);
+				}
+			}
+			return index;
+		}
+
+		// Reorders indices[0..n) by the Hilbert index of the cell of the particles they point to in the set.
+		// Particles in the same cell keep their relative order. The map is width x height cells
+		void sort(const ParticleSet &particles, unsigned *indices, unsigned n, int width, int height) {
+			unsigned order_bits = 0;
+			while ((1 << order_bits) < std::max(width, height)) {
+				++order_bits;
+			}
+			const int side = 1 << order_bits;
+			const unsigned nthreads = n >= PARALLEL_THRESHOLD ? num_threads : 1;
+
+			keys.resize(n);
+			sorted_keys.resize(n);
+			order.assign(indices, indices + n);
+			sorted_order.resize(n);
+
+			#pragma omp parallel for num_threads(nthreads)
+			for (int i=0; i<(int)n; ++i) {
+				// Particles outside the map are clamped to its border
+				const int x = std::min(std::max((int)particles.x[indices[i]], 0), side - 1);
+				const int y = std::min(std::max((int)particles.y[indices[i]], 0), side - 1);
+				keys[i] = hilbertIndex(order_bits, x, y);
+			}
+
+			// Only the digits the indices can use
+			for (unsigned shift=0; shift<2*order_bits; shift+=RADIX_BITS) {
+				radix_pass(n, shift, nthreads);
+			}
+			std::copy(order.begin(), order.end(), indices);
+		}
+};
+
+#endif
@@ -0,0 +1,71 @@
+// Sphere tracing over the distance field of the map (see DistanceTransform.h). No wall is closer to a point of
+// the ray than the distance stored for its cell minus the distance from the point to the cell centre,
+// so the ray can jump that far at once. Close to the walls, where the jumps become shorter than a cell,
+// it falls back to exact cell by cell steps as in DDATraversal.
+
+#ifndef SPHERE_TRACING_H
+#define SPHERE_TRACING_H
+
+#include <cmath>
+#include <algorithm>
+#include "Map.h"
+#include "RayCaster.h"
+
+class SphereTracing : public RayCaster {
+
+	private:
+		const Map &map;
+		
+		// The distance field is measured between cell centres: a point of the ray and a point of the closest wall
+		// can each be half a diagonal away from the centre of their cell
+		const float CELL_DIAGONAL = std::sqrt(2.0f);
+		// Jumps shorter than this are replaced by a step to the next cell border
+		const float MIN_JUMP = 1.0f;
+		// Nudge past a cell border so the floor lands on the next cell
+		const float BORDER_EPSILON = 1e-4f;
+		
+	public:
+		SphereTracing(const Map &user_map): map(user_map) {}
+		
+		float range(float x, float y, float alpha, unsigned horizon_length) const {
+			const float dx = std::cos(alpha);
+			const float dy = std::sin(alpha);
+			const float inv_dx = 1.0f/dx;
+			const float inv_dy = 1.0f/dy;
+			
+			const unsigned cols = map.width();
+			const unsigned rows = map.height();
+			const float *distance = map.distance.data(); // row major, so horizontal rays read consecutive cells
+			
+			float t = 0.0f;
+			while (t < horizon_length) {
+				const float px = x + t*dx;
+				const float py = y + t*dy;
+				// Truncation only differs from floor for negative coordinates, which are outside the map anyway
+				const int cell_x = (int)px;
+				const int cell_y = (int)py;
+				if (px < 0.0f || py < 0.0f || (unsigned)cell_x >= cols || (unsigned)cell_y >= rows) {
+					return t;
+				}
+				
+				const float d = distance[(size_t)cell_y*cols + cell_x];
+				if (d == 0.0f) {
+					return t;
+				}
+				
+				// Either jump, or step to the next cell border if that goes further (this cell is free)
+				const float jump = d - CELL_DIAGONAL;
+				if (jump >= MIN_JUMP) {
+					t += jump;
+				} else {
+					const float next_x = dx == 0.0f ? INFINITY : (dx > 0.0f ? cell_x + 1 - px : cell_x - px)*inv_dx;
+					const float next_y = dy == 0.0f ? INFINITY : (dy > 0.0f ? cell_y + 1 - py : cell_y - py)*inv_dy;
+					t += std::max(jump, std::min(next_x, next_y) + BORDER_EPSILON);
+				}
+			}
+			
+			return -1;
+		}
+};
+
+#endif
@@ -0,0 +1,126 @@
+// Fixed set of worker threads running the tasks posted to a shared queue, in the order they were posted.
+// A Strand runs its own tasks one at a time and in order on the pool, without holding a worker while it has
+// nothing to do: the tasks of one robot never run concurrently, while different robots spread over the workers.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+class ThreadPool {
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()> > tasks;
+		std::mutex mutex;
+		std::condition_variable task_available;
+		bool stopping = false;
+
+		void work() {
+			for (;;) {
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					task_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+					if (tasks.empty()) {
+						return;
+					}
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+	public:
+		// One worker per core by default
+		ThreadPool(unsigned nthreads = 0) {
+			if (nthreads == 0) {
+				nthreads = std::max(1u, std::thread::hardware_concurrency());
+			}
+			for (unsigned i=0; i<nthreads; ++i) {
+				workers.emplace_back(&ThreadPool::work, this);
+			}
+		}
+
+		// Runs the tasks already posted, then stops the workers
+		~ThreadPool() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			task_available.notify_all();
+			for (auto &worker : workers) {
+				worker.join();
+			}
+		}
+
+		void post(std::function<void()> task) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push_back(std::move(task));
+			}
+			task_available.notify_one();
+		}
+
+		unsigned size() const {
+			return workers.size();
+		}
+};
+
+class Strand {
+
+	private:
+		ThreadPool &pool;
+		std::deque<std::function<void()> > tasks;
+		std::mutex mutex;
+		bool scheduled = false; // a worker is running the tasks of the strand, or has been asked to
+
+		// Runs the pending tasks until the queue is empty
+		void drain() {
+			for (;;) {
+				std::function<void()> task;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (tasks.empty()) {
+						scheduled = false;
+						return;
+					}
+					task = std::move(tasks.front());
+					tasks.pop_front();
+				}
+				task();
+			}
+		}
+
+	public:
+		Strand(ThreadPool &thread_pool): pool(thread_pool) {}
+
+		// The strand must outlive its tasks: destroy it only after the pool
+		void post(std::function<void()> task) {
+			bool schedule;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.push_back(std::move(task));
+				schedule = !scheduled;
+				scheduled = true;
+			}
+			if (schedule) {
+				pool.post([this]() { drain(); });
+			}
+		}
+
+		// Tasks waiting to run
+		unsigned pending() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return tasks.size();
+		}
+};
+
+#endif
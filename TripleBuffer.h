@@ -0,0 +1,51 @@
+// Latest-value channel between one writer thread and one reader thread, with three buffers:
+// the writer fills its back buffer and publishes it by swapping it with the middle one, the reader takes the middle
+// one when it is newer than its front buffer. The swaps are a single atomic exchange, so neither side waits for the
+// other: the writer never blocks on a slow reader (intermediate values are just skipped) and the reader always has
+// a complete value. The buffers are reused, so values whose storage has grown are not reallocated.
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <class T>
+class TripleBuffer {
+
+	private:
+		static const unsigned FRESH = 4; // set in middle when it holds a value the reader has not taken
+
+		T buffers[3];
+		unsigned back = 0; // writer only
+		unsigned front = 1; // reader only
+		std::atomic<unsigned> middle;
+
+	public:
+		TripleBuffer(): middle(2) {}
+
+		// Writer only: the buffer to fill before publish()
+		T& backBuffer() {
+			return buffers[back];
+		}
+
+		// Writer only: makes the back buffer available to the reader and takes over the old middle one
+		void publish() {
+			back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+		}
+
+		// Reader only: switches to the last published value, if there is a new one. Returns whether it did
+		bool update() {
+			if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+				return false;
+			}
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+			return true;
+		}
+
+		// Reader only: the value taken by the last update()
+		const T& frontBuffer() const {
+			return buffers[front];
+		}
+};
+
+#endif
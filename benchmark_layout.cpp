@@ -0,0 +1,149 @@
+// Compares the row major and the tiled (Z-order) layouts of the occupancy grid:
+// time of the validity checks of a particle cloud and of the DDA ray casts, and cache lines touched per ray.
+// Usage: benchmark_layout [scene.xml] [cells_per_metre]
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <set>
+#include <random>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "MapGenerator.h"
+#include "DDATraversal.h"
+
+const unsigned NUM_QUERIES = 100000;
+const unsigned REPETITIONS = 7;
+const float LIDAR_MAX = 2.0f; // metres
+
+struct Queries {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> alpha;
+};
+
+// Free positions, either spread over the whole map or in a cloud around a random free cell, as after convergence
+Queries generate_queries(const Map &map, bool clustered, std::mt19937 &gen) {
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	std::normal_distribution<float> normal(0.0f, 0.05f*map.cellsPerMetre);
+
+	float centre_x, centre_y;
+	do {
+		centre_x = uniform(gen)*map.width();
+		centre_y = uniform(gen)*map.height();
+	} while (!map.isFree(centre_x, centre_y));
+	const float heading = uniform(gen)*2.0f*M_PI;
+
+	Queries q;
+	while (q.x.size() < NUM_QUERIES) {
+		const float x = clustered ? centre_x + normal(gen) : uniform(gen)*map.width();
+		const float y = clustered ? centre_y + normal(gen) : uniform(gen)*map.height();
+		if (map.isFree(x, y)) {
+			q.x.push_back(x);
+			q.y.push_back(y);
+			q.alpha.push_back(clustered ? heading + 0.1f*normal(gen)/map.cellsPerMetre : uniform(gen)*2.0f*M_PI);
+		}
+	}
+	return q;
+}
+
+// Best time of REPETITIONS runs, in nanoseconds per query
+template <class F>
+double time_per_query(F f) {
+	double best = 1e30;
+	for (unsigned r=0; r<REPETITIONS; ++r) {
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return best/NUM_QUERIES*1e9;
+}
+
+// Distinct cache lines holding the cells visited by the ray, with the same traversal as DDATraversal
+unsigned cache_lines(const Map &map, float x, float y, float alpha, unsigned horizon_length) {
+	const float dx = std::cos(alpha);
+	const float dy = std::sin(alpha);
+	int cell_x = (int)std::floor(x);
+	int cell_y = (int)std::floor(y);
+	const float delta_x = dx != 0.0f ? std::abs(1.0f/dx) : INFINITY;
+	const float delta_y = dy != 0.0f ? std::abs(1.0f/dy) : INFINITY;
+	float next_x = dx != 0.0f ? (dx > 0.0f ? cell_x + 1 - x : x - cell_x)*delta_x : INFINITY;
+	float next_y = dy != 0.0f ? (dy > 0.0f ? cell_y + 1 - y : y - cell_y)*delta_y : INFINITY;
+
+	const uintptr_t base = (uintptr_t)map.grid.data();
+	std::set<uintptr_t> lines;
+	float t = 0.0f;
+	while (t < horizon_length) {
+		lines.insert((base + map.grid.offset(cell_x, cell_y))/OccupancyGrid::CACHE_LINE);
+		if (map.grid.at(cell_x, cell_y) != 0) {
+			break;
+		}
+		if (next_x < next_y) {
+			t = next_x;
+			next_x += delta_x;
+			cell_x += dx > 0.0f ? 1 : -1;
+		} else {
+			t = next_y;
+			next_y += delta_y;
+			cell_y += dy > 0.0f ? 1 : -1;
+		}
+	}
+	return lines.size();
+}
+
+int main(int narg, char *arg[]) {
+	const std::string scene = narg > 1 ? arg[1] : "pasillo.xml";
+	const int cells_per_metre = narg > 2 ? std::stoi(arg[2]) : 100;
+
+	MapGenerator generator(scene, 3, cells_per_metre);
+	const MapHandle map = generator.generateMap();
+	const unsigned horizon_length = LIDAR_MAX*cells_per_metre;
+
+	std::cout << "Map " << map->width() << "x" << map->height() << " cells" << std::endl;
+	std::cout << std::setw(10) << "layout" << std::setw(10) << "queries" << std::setw(10) << "KB"
+			  << std::setw(14) << "isFree ns" << std::setw(12) << "ray ns" << std::setw(14) << "lines/ray" << std::endl;
+
+	const GridLayout layouts[2] = {ROW_MAJOR, TILED};
+	const char *layout_names[2] = {"row", "tiled"};
+	for (int clustered=0; clustered<2; ++clustered) {
+		std::mt19937 gen(1);
+		const Queries q = generate_queries(*map, clustered, gen);
+
+		for (int l=0; l<2; ++l) {
+			const MapHandle layout_map = map.withLayout(layouts[l]);
+			DDATraversal dda(*layout_map);
+
+			volatile unsigned free_cells = 0;
+			const double check_ns = time_per_query([&]() {
+				unsigned count = 0;
+				for (unsigned i=0; i<NUM_QUERIES; ++i) {
+					count += layout_map->isFree(q.x[i], q.y[i]);
+				}
+				free_cells = count;
+			});
+
+			volatile float sum = 0.0f;
+			const double ray_ns = time_per_query([&]() {
+				float s = 0.0f;
+				for (unsigned i=0; i<NUM_QUERIES; ++i) {
+					s += dda.range(q.x[i], q.y[i], q.alpha[i], horizon_length);
+				}
+				sum = s;
+			});
+
+			double lines = 0.0;
+			for (unsigned i=0; i<NUM_QUERIES; ++i) {
+				lines += cache_lines(*layout_map, q.x[i], q.y[i], q.alpha[i], horizon_length);
+			}
+
+			std::cout << std::fixed << std::setprecision(1)
+					  << std::setw(10) << layout_names[l] << std::setw(10) << (clustered ? "cloud" : "spread")
+					  << std::setw(10) << layout_map->grid.memoryUsage()/1024.0
+					  << std::setw(14) << check_ns << std::setw(12) << ray_ns << std::setw(14) << lines/NUM_QUERIES << std::endl;
+		}
+	}
+
+	return 0;
+}
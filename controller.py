@@ -2,6 +2,8 @@ import bluetooth
 import keyboard
 import zmq
 import time
+import sys
+import struct
 
 #### CONSTANTS
 
@@ -32,8 +34,31 @@ SENSOR_DATA_MAX_LENGTH = 10 #bytes
 # ZMQ socket contants
 LOCALHOST_PORT = "5555"
 
+# Robot identifier for localization_server (python controller.py <robot_id>), 0 by default
+ROBOT_ID = int(sys.argv[1]) if len(sys.argv) > 1 else 0
+
+# Frame sent to the localization programs, see Frame.h: magic, version, command, beam count, reserved,
+# robot id, sequence number, timestamp in microseconds, then the ranges in metres
+FRAME_HEADER = struct.Struct('<2sBBHHIIQ')
+FRAME_MAGIC = b'PF'
+FRAME_VERSION = 1
+
 ####
 
+def pack_frame(sequence, command, ranges):
+    header = FRAME_HEADER.pack(FRAME_MAGIC, FRAME_VERSION, int(command), len(ranges), 0,
+                               ROBOT_ID, sequence & 0xFFFFFFFF, time.time_ns() // 1000)
+    return header + struct.pack('<%df' % len(ranges), *ranges)
+
+
+# Lidar reading in mm as sent by the robot, 0 if it cannot be parsed
+def lidar_range(sensor_data):
+    try:
+        return float(sensor_data)/1000.0
+    except ValueError:
+        return 0.0
+
+
 # Socket for arduino communication through bluetooth
 bt_sock = bluetooth.BluetoothSocket( bluetooth.RFCOMM )
 bt_sock.connect((BD_ADDR, PORT))
@@ -90,6 +115,7 @@ def broadcast_user_commands_loop():
 	# --------->
 	
 	start_time = time.perf_counter()
+	sequence = 0
 
 	while not exit:
 	
@@ -107,9 +133,9 @@ def broadcast_user_commands_loop():
 				print(e)
 				break	
 					
-			# Send message to C++ program
-			zmq_socket.send_string(command)
-			zmq_socket.send_string(lidar_sensor_data)
+			# Send message to C++ program: the command and the reading in a single frame
+			zmq_socket.send(pack_frame(sequence, command, [lidar_range(lidar_sensor_data)]))
+			sequence += 1
 			
 			# Reset timer
 			start_time = current_time
@@ -4,6 +4,8 @@ import bluetooth
 import keyboard
 import zmq
 import time
+import sys
+import struct
 
 #### CONSTANTS
 
@@ -29,8 +31,31 @@ COMMUNICATION_DELAY = 1/20 # in seconds
 # ZMQ socket contants
 LOCALHOST_PORT = "5555"
 
+# Robot identifier for localization_server (python controller_debug.py <robot_id>), 0 by default
+ROBOT_ID = int(sys.argv[1]) if len(sys.argv) > 1 else 0
+
+# Frame sent to the localization programs, see Frame.h: magic, version, command, beam count, reserved,
+# robot id, sequence number, timestamp in microseconds, then the ranges in metres
+FRAME_HEADER = struct.Struct('<2sBBHHIIQ')
+FRAME_MAGIC = b'PF'
+FRAME_VERSION = 1
+
 ####
 
+def pack_frame(sequence, command, ranges):
+    header = FRAME_HEADER.pack(FRAME_MAGIC, FRAME_VERSION, int(command), len(ranges), 0,
+                               ROBOT_ID, sequence & 0xFFFFFFFF, time.time_ns() // 1000)
+    return header + struct.pack('<%df' % len(ranges), *ranges)
+
+
+# Lidar reading in mm as sent by the robot, 0 if it cannot be parsed
+def lidar_range(sensor_data):
+    try:
+        return float(sensor_data)/1000.0
+    except ValueError:
+        return 0.0
+
+
 lidar_sensor_data = "1000.0"
 
 # Socket for communication with localization program
@@ -84,6 +109,7 @@ def broadcast_user_commands_loop():
 	# --------->
 	
 	start_time = time.perf_counter()
+	sequence = 0
 
 	while not exit:
 	
@@ -99,9 +125,9 @@ def broadcast_user_commands_loop():
 				print(e)
 				break	
 					
-			# Send message to C++ program
-			zmq_socket.send_string(command)
-			zmq_socket.send_string(lidar_sensor_data)
+			# Send message to C++ program: the command and the reading in a single frame
+			zmq_socket.send(pack_frame(sequence, command, [lidar_range(lidar_sensor_data)]))
+			sequence += 1
 			
 			# Reset timer
 			start_time = current_time
@@ -32,10 +32,12 @@ int main() {
 	Listener listener;
 	
 	MapGenerator generator("pasillo.xml", MAP_MARGIN, MAP_CELLS_PER_METRE);
-	Map map = generator.generateMap();
+	MapHandle map = generator.generateMap();
 	      
 	MapPlotter map_plotter(map, WINDOW_SIZE, WINDOW_SIZE, MAP_MARGIN, {"./robot.png"});
 	
+	FrameView frame;
+	
 	float alpha = 0.0f; //Assuming original angle of 0
 	float x, y; 
 	x=y=1.0f; // Position about the center of the room
@@ -43,33 +45,36 @@ int main() {
 	
 	while(map_plotter.isOpen()){
 	
-		//  Wait for next command from user
-        std::string command = listener.receive(true);
-        // Receive sensor data
-        std::string lidar_sensor_data = listener.receive(true);
+		//  Wait for next frame from user (see Frame.h)
+        if (!listener.receiveFrame(frame, true) || !frame.valid()) {
+        	continue;
+        }
+        const unsigned command = frame.command();
         
         // Print out received message
         std::cout << "Command received from client: " << command << std::endl;
-        std::cout << "Lidar sensor data: " + lidar_sensor_data << std::endl;
+        if (frame.beamCount() > 0) {
+        	std::cout << "Lidar sensor data: " << frame.range(0) << std::endl;
+        }
         
         //Register movement based on command
-        if (command=="0"){}
-        else if (command=="1") {
+        if (command==0){}
+        else if (command==1) {
         	x += SPEED_F*cos(alpha)*COMMAND_DURATION;
         	y += SPEED_F*sin(alpha)*COMMAND_DURATION;
-        } else if (command=="2") {
+        } else if (command==2) {
         	x -= SPEED_B*cos(alpha)*COMMAND_DURATION;
     		y -= SPEED_B*sin(alpha)*COMMAND_DURATION;
-        } else if (command=="3"){
+        } else if (command==3){
         	alpha -= SPEED_R*COMMAND_DURATION;
-        } else if (command=="4"){
+        } else if (command==4){
         	alpha += SPEED_R*COMMAND_DURATION;
         }
 
         
         // Transform position to map coordinates
-        int x_map = (int)(x*map.cellsPerMetre);
-        int y_map = (int)(y*map.cellsPerMetre);
+        int x_map = (int)(x*map->cellsPerMetre);
+        int y_map = (int)(y*map->cellsPerMetre);
         
         std::cout << "x: " << x << std::endl;
         std::cout << "y: " << y << std::endl;
@@ -7,29 +7,54 @@
 #include "MapGenerator.h"
 #include "Listener.h"
 #include "ParticleFilter.h"
+#include "FilterSetup.h"
+#include "DeadlineController.h"
+#include "AllocationCounter.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
 
 #include <chrono>
 #include <thread> // For sleep_for() call
+#include <atomic>
 
 #define WINDOW_SIZE 1000
-#define MAP_MARGIN 3
-#define MAP_CELLS_PER_METRE 100
-
-
-// Particle filter parameters
-//const int NPART = 10000;  // Now we pass the number of particles as argument
-const float SPEED_F = 0.22f; // meters/second
-const float SPEED_B = 0.2f; // meters/second
-const float SPEED_R = 2.0f*M_PI; // rads/second
-const float COMMAND_DURATION = 1.0f/20.0f; // aproximation of command duration
-const float S_X_F = 0.03f;
-const float S_Y_F = 0.01f;
-const float S_X_B = 0.02f;
-const float S_Y_B = 0.01f;
-const float S_ALPHA = 0.5f;
-const float S_LIDAR = 0.2f;
-const float LIDAR_MIN = 0.2f;
-const float LIDAR_MAX = 2.0f;
+
+
+const int REPORT_PERIOD = 100; // cycles between two reports of the cycle time
+
+// Pipeline
+const unsigned READING_QUEUE_SIZE = 64; // readings received and not yet processed by the filter
+const unsigned RENDER_FPS = 30;
+const std::chrono::microseconds IDLE_WAIT(500); // sleep of the I/O and filter threads when they have nothing to do
+
+// Particles drawn by the render thread
+struct ParticleSnapshot {
+	std::vector<coord2D> coords;
+	std::vector<int> opacities; // The opacity of a particle is proportional to its likelihood.
+};
+
+#ifdef COUNT_ALLOCATIONS
+// Counts every allocation of the program (see AllocationCounter.h)
+void* operator new(size_t size) {
+	allocation_counter::add();
+	if (void *ptr = std::malloc(size > 0 ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+#endif
 
 void sleep(int t){
 
@@ -42,106 +67,195 @@ int main( int narg, char *arg[] ) {
 
 	if (narg < 2) {
 		std::cout << "Provide the number of particles as argument." <<std::endl;
+		std::cout << "Usage: " << arg[0] << " <particles> [options]" <<std::endl;
+		std::cout << "  --deadline <ms>  adapt the number of particles so a cycle fits in the given time" <<std::endl;
+		printFilterOptions();
 		return -1;
 	}
 	
 	const int NPART(std::stoi(arg[1]));
+	
+	FilterOptions options;
+	float deadline_ms = 0.0f;
+	
+	for (int i=2; i<narg; ++i) {
+		std::string option(arg[i]);
+		if (option == "--deadline" && i+1 < narg) {
+			deadline_ms = std::stof(arg[++i]);
+		} else if (!parseFilterOption(narg, arg, i, options)) {
+			std::cout << "Unknown option " << option << std::endl;
+			return -1;
+		}
+	}
 
 	Listener listener;
 	
 	MapGenerator generator("pasillo.xml", MAP_MARGIN, MAP_CELLS_PER_METRE);
-	Map map = generator.generateMap();
+	MapHandle map = generator.generateMap();
 	
 	MapPlotter map_plotter(map, WINDOW_SIZE, WINDOW_SIZE, MAP_MARGIN, {});
 	
 	ParticleFilter pf(NPART, map, SPEED_F, SPEED_B, SPEED_R, COMMAND_DURATION,
 					  S_X_F, S_Y_F, S_X_B, S_Y_B, S_ALPHA, S_LIDAR, LIDAR_MIN, LIDAR_MAX);
+	
+	configureFilter(pf, options, NPART);
+	
+	// With a deadline, the number of particles is also bounded by what fits in the budget
+	DeadlineController deadline(deadline_ms/1000.0f, options.min_particles, NPART);
+	
 	pf.randomize();
 	
-	float previous_lidar_sensor_data = 0.0f;
+	// The program runs as a pipeline of three threads, so receiving and drawing never delay the filter:
+	//  - I/O: receives the messages and queues the readings for the filter
+	//  - filter: updates the particle filter with the readings received and publishes a snapshot of the particles
+	//  - render (this thread, which owns the window): draws the last snapshot at its own frame rate
+	SPSCQueue<Reading> readings(READING_QUEUE_SIZE);
+	TripleBuffer<ParticleSnapshot> snapshots;
+	std::atomic<bool> running(true);
 	
-	while(map_plotter.isOpen()){
+	std::thread io_thread([&]() {
+		FrameView frame;
+		Reading reading;
+		uint32_t expected_sequence = 0;
+		
+		while (running) {
+			//  Wait for next frame from user (polling, to notice when the window is closed)
+			if (!listener.receiveFrame(frame, false)) {
+				std::this_thread::sleep_for(IDLE_WAIT);
+				continue;
+			}
+			if (!frame.valid() || frame.command() > TURN_RIGHT) {
+				std::cout << "Ignoring a message that is not a valid frame" << std::endl;
+				continue;
+			}
+			
+			// A lower sequence number is a restarted controller
+			if (frame.sequence() > expected_sequence && expected_sequence > 0) {
+				std::cout << "Lost " << frame.sequence() - expected_sequence << " messages" << std::endl;
+			}
+			expected_sequence = frame.sequence() + 1;
+			
+			if (frame.command() == DO_NOTHING && !options.stationary_updates) {
+//				std::cout << "STOP" << std::endl;
+				continue;
+			}
+			
+			decodeReading(frame, reading);
+			// If the filter is too far behind, waits for it
+			while (!readings.push(reading) && running) {
+				std::this_thread::yield();
+			}
+		}
+	});
 	
-		//  Wait for next command from user
-        std::string command = listener.receive(true);
-        // Receive sensor data
-        float lidar_sensor_data = std::stof(listener.receive(true))/1000.0f;
-		//lidar_sensor_data = 0.0f;
-        
-        // Print out received message
-//        std::cout << "Command received from client: " << command << std::endl;
-//        std::cout << "Lidar sensor data: " << lidar_sensor_data << std::endl;
-        
-//        std::cout << "Command: " << command << std::endl;
-//        std::cout << "Command size: " << command.size() << std::endl;
-        
-        //Register movement based on command
-        if (command != "0") {
-        
-		    if (command=="1") {
-		    	pf.move(GO_FORWARD);
-		    } else if (command=="2") {
-		    	pf.move(GO_BACK);
-		    } else if (command=="3"){
-		    	pf.move(TURN_LEFT);
-		    } else if (command=="4"){
-		    	pf.move(TURN_RIGHT);
-		    }
-		    
-		    ////Update pf and resample
-		    // If the lidar sensor gives value 0.0 or there is a huge change from the previous information
-		    // there might have been an error with the read, so we will not use it
-		    float lidar_data_variation = abs(lidar_sensor_data-previous_lidar_sensor_data);
-		    if(lidar_sensor_data == 0.0f || lidar_data_variation > previous_lidar_sensor_data*0.2f) {
-		    	std::cout << "Ignoring lidar information" << std::endl;
-		    	pf.updateLikelihood();
-		    } else {
-		    	pf.updateLikelihood(lidar_sensor_data);
-		    }
-
-		    pf.resample();
-		    previous_lidar_sensor_data = lidar_sensor_data;
-		    
-		    //// Draw changes on the map
-		    
-		    map_plotter.drawElements( {}, {} );
-		    
-		    // Read parameters from particles
-		    std::vector<coord2D> coords;
-		    //std::vector<float> orientations;
-		    std::vector<int> opacities; // The opacity of a particle is proportional to its likelihood.
-		    float max_likelihood = 0.0f;
-		    for(auto p : pf.getParticles()) {
-		    	coords.push_back(p.coord);
-		    	//std::cout << "Likelihood:" << p.likelihood << std::endl;
-		    	//orientations.push_back(p.alpha);
-		    	opacities.push_back(p.likelihood);
-		    	if(p.likelihood > max_likelihood) {
-		    		max_likelihood = p.likelihood;
-		    	}
-		    }
-		    // Normalize particle weight to be used as opacity value
-		    if (max_likelihood > 0.0f) {
-				for(auto it=opacities.begin(); it!=opacities.end(); ++it) {
+	std::thread filter_thread([&]() {
+		CycleState cycle;
+#ifdef COUNT_ALLOCATIONS
+		unsigned long cycles = 0;
+		unsigned long allocations_at_report = allocation_counter::allocations();
+#endif
+		
+		Reading reading;
+		CommandRun runs[READING_QUEUE_SIZE];
+		while (running) {
+			if (!readings.pop(reading)) {
+				std::this_thread::sleep_for(IDLE_WAIT);
+				continue;
+			}
+			
+			deadline.startCycle();
+			
+			// Takes every reading queued while the last cycle ran, so a slow cycle does not leave the filter replaying
+			// a growing backlog: runs of the same command become one motion and only the latest lidar reading is used
+			unsigned nruns = 1;
+			runs[0].command = reading.command;
+			runs[0].steps = 1;
+			while (nruns < READING_QUEUE_SIZE && readings.pop(reading)) {
+				if (reading.command == runs[nruns-1].command) {
+					++runs[nruns-1].steps;
+				} else {
+					runs[nruns].command = reading.command;
+					runs[nruns].steps = 1;
+					++nruns;
+				}
+			}
+			// reading now holds the latest one
+			
+			// A cycle without motion only processes the stored particles, a motion expands the copies of a compressed set
+			const unsigned cycle_particles = hasMotion(runs, nruns) ? pf.getNumParticles() : pf.getParticleSet().size();
+			
+			if (!runCycle(pf, runs, nruns, reading, cycle)) {
+				std::cout << "Ignoring lidar information" << std::endl;
+			}
+			
+			//// Snapshot of the particles for the render thread (the copies of a compressed set are drawn once)
+			
+			ParticleSnapshot &snapshot = snapshots.backBuffer();
+			const ParticleSet &particles = pf.getParticleSet();
+			snapshot.coords.clear();
+			snapshot.opacities.clear();
+			float max_likelihood = 0.0f;
+			for(unsigned i=0; i<particles.size(); ++i) {
+				const float likelihood = std::exp(particles.log_weight[i]);
+				snapshot.coords.push_back(coord2D(particles.x[i], particles.y[i]));
+				//std::cout << "Likelihood:" << likelihood << std::endl;
+				snapshot.opacities.push_back(likelihood);
+				if(likelihood > max_likelihood) {
+					max_likelihood = likelihood;
+				}
+			}
+			// Normalize particle weight to be used as opacity value
+			if (max_likelihood > 0.0f) {
+				for(auto it=snapshot.opacities.begin(); it!=snapshot.opacities.end(); ++it) {
 					*it /= max_likelihood/255;
 					if (*it < 100) {
 						*it = 100;
 					}
 				}
-		    }
-		    
-		    //Draw particles
-		    for(int i=0; i<NPART; ++i) {
-		    	map_plotter.drawCircle(coords[i], opacities[i]);
-		    }
+			}
+			snapshots.publish();
 			
-			map_plotter.update();
+#ifdef COUNT_ALLOCATIONS
+			if (++cycles % REPORT_PERIOD == 0) {
+				const unsigned long allocations = allocation_counter::allocations();
+				std::cout << "Allocations in the last " << REPORT_PERIOD << " cycles: " << allocations - allocations_at_report << std::endl;
+				allocations_at_report = allocations;
+			}
+#endif
 			
-        } else {
-//        	std::cout << "STOP" << std::endl;
-        }
-        
+			if (deadline_ms > 0.0f) {
+				pf.setParticleBudget(deadline.endCycle(cycle_particles));
+				
+				if (deadline.getCycles() % REPORT_PERIOD == 0) {
+					std::cout << "Cycle time: " << deadline.getLastCycleTime()*1000.0 << " ms, "
+							  << "particles: " << pf.getNumParticles() << ", "
+							  << "deadline misses: " << deadline.getDeadlineMisses() << "/" << deadline.getCycles() << std::endl;
+				}
+			}
+		}
+	});
+	
+	map_plotter.setFramerateLimit(RENDER_FPS);
+	while(map_plotter.isOpen()){
+		
+		//// Draw the last snapshot on the map
+		
+		snapshots.update();
+		const ParticleSnapshot &snapshot = snapshots.frontBuffer();
+		
+		map_plotter.drawElements( {}, {} );
+		
+		//Draw particles
+		for(unsigned i=0; i<snapshot.coords.size(); ++i) {
+			map_plotter.drawCircle(snapshot.coords[i], snapshot.opacities[i]);
+		}
+		
+		map_plotter.update();
 	}
 	
+	running = false;
+	io_thread.join();
+	filter_thread.join();
+	
 	return 0;
 }
@@ -0,0 +1,140 @@
+// Localization of several robots in the same map by one process, without a window.
+// Every message is a frame (see Frame.h) carrying the id of the robot, see controller.py.
+// Each robot gets its own particle filter the first time it is seen. All the filters share the map and its ray casting
+// tables (see MapHandle), and their updates run on a thread pool: the updates of one robot are queued on its strand,
+// so they run in order and one at a time, while different robots are updated in parallel.
+
+#include <eigen3/Eigen/Dense>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <cmath>
+
+#include "MapGenerator.h"
+#include "Listener.h"
+#include "ParticleFilter.h"
+#include "FilterSetup.h"
+#include "ThreadPool.h"
+
+const int REPORT_PERIOD = 100; // messages between two reports of the estimated poses
+
+// State of one robot. The filter is only used by the tasks of the strand
+struct Session {
+	ParticleFilter pf;
+	Strand strand;
+	CycleState cycle;
+
+	// Written at the end of every update, read by the reports
+	std::mutex estimate_mutex;
+	particle estimate;
+	unsigned particles;
+	unsigned long updates = 0;
+
+	Session(unsigned npart, const MapHandle &map, ThreadPool &pool):
+			pf(npart, map, SPEED_F, SPEED_B, SPEED_R, COMMAND_DURATION,
+			   S_X_F, S_Y_F, S_X_B, S_Y_B, S_ALPHA, S_LIDAR, LIDAR_MIN, LIDAR_MAX),
+			strand(pool), particles(npart) {}
+};
+
+// One cycle of the filter of a robot (see runCycle)
+void update(Session &session, const Reading &reading) {
+	ParticleFilter &pf = session.pf;
+
+	runCycle(pf, reading, session.cycle);
+
+	const particle estimate = pf.estimatePose();
+	std::lock_guard<std::mutex> lock(session.estimate_mutex);
+	session.estimate = estimate;
+	session.particles = pf.getNumParticles();
+	++session.updates;
+}
+
+int main( int narg, char *arg[] ) {
+
+	if (narg < 2) {
+		std::cout << "Provide the number of particles per robot as argument." <<std::endl;
+		std::cout << "Usage: " << arg[0] << " <particles> [options]" <<std::endl;
+		std::cout << "  --threads <n>    worker threads (default: one per core)" <<std::endl;
+		printFilterOptions();
+		return -1;
+	}
+
+	const int NPART(std::stoi(arg[1]));
+
+	unsigned num_threads = 0;
+	FilterOptions options;
+
+	for (int i=2; i<narg; ++i) {
+		std::string option(arg[i]);
+		if (option == "--threads" && i+1 < narg) {
+			num_threads = std::stoi(arg[++i]);
+		} else if (!parseFilterOption(narg, arg, i, options)) {
+			std::cout << "Unknown option " << option << std::endl;
+			return -1;
+		}
+	}
+
+	Listener listener;
+
+	MapGenerator generator("pasillo.xml", MAP_MARGIN, MAP_CELLS_PER_METRE);
+	MapHandle map = generator.generateMap();
+
+	// Declared before the pool, so the pool (which runs the tasks left) is destroyed first
+	std::map<uint32_t, std::unique_ptr<Session> > sessions; // by robot id
+	ThreadPool pool(num_threads);
+	std::cout << "Localization server with " << pool.size() << " worker threads" << std::endl;
+
+	FrameView frame;
+	unsigned long messages = 0;
+
+	for (;;) {
+
+		if (!listener.receiveFrame(frame, true)) {
+			continue;
+		}
+		if (!frame.valid() || frame.command() > TURN_RIGHT) {
+			std::cout << "Ignoring a message that is not a valid frame" << std::endl;
+			continue;
+		}
+
+		std::unique_ptr<Session> &session = sessions[frame.robotId()];
+		if (!session) {
+			session.reset(new Session(NPART, map, pool));
+			ParticleFilter &pf = session->pf;
+			// The pool already uses every core: each filter runs on one thread
+			pf.setNumThreads(1);
+			configureFilter(pf, options, NPART);
+			pf.randomize();
+			std::cout << "New robot: " << frame.robotId() << " (" << sessions.size() << " robots)" << std::endl;
+		}
+
+		// Readings without motion are only used with --stationary, as in localization_pf
+		if (frame.command() != DO_NOTHING || options.stationary_updates) {
+			// The frame is only valid until the next message: the task gets a copy of the reading
+			Reading reading;
+			decodeReading(frame, reading);
+			Session *s = session.get();
+			s->strand.post([s, reading]() {
+				update(*s, reading);
+			});
+		}
+
+		if (++messages % REPORT_PERIOD == 0) {
+			for (auto &entry : sessions) {
+				Session &s = *entry.second;
+				std::lock_guard<std::mutex> lock(s.estimate_mutex);
+				std::cout << "Robot " << entry.first << ": "
+						  << "x " << s.estimate.coord.x/map->cellsPerMetre << " m, "
+						  << "y " << s.estimate.coord.y/map->cellsPerMetre << " m, "
+						  << "alpha " << s.estimate.alpha*180.0f/M_PI << " deg, "
+						  << "updates " << s.updates << ", "
+						  << "pending " << s.strand.pending() << ", "
+						  << "particles " << s.particles << std::endl;
+			}
+		}
+	}
+
+	return 0;
+}